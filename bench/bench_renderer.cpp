@@ -0,0 +1,424 @@
+#include "../include/rendering.hpp"
+#include "../include/mesh.hpp"
+#include "../include/texture.hpp"
+#include "../include/log.hpp"
+#include "../include/memory_tracker.hpp"
+#include "../include/util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Headless benchmark of the tile-based pipeline. Sweeps synthetic scenes over
+// triangle count, triangle size distribution, depth complexity and textured fraction
+// at several resolutions and writes the results as JSON and/or CSV.
+//
+//   bench_renderer [--frames N] [--warmup N] [--resolution WxH]... [--quick]
+//                  [--json FILE] [--csv FILE] [--no-profile]
+//
+// The device is picked with LR_DEVICE like in the demos. Per-stage times need a profiling
+// queue, which the benchmark turns on unless --no-profile is given (profiling adds a little
+// overhead to every command).
+
+namespace {
+
+const int SCR_Z = 1000;
+
+enum SizeDistribution {
+    SIZES_UNIFORM,  // Every triangle has the mean area
+    SIZES_MIXED,    // Log-uniform between 1/16 and 4 times the mean area
+    SIZES_SKEWED,   // 90% tiny triangles, the remaining 10% cover most of the area
+};
+
+const char* sizeDistributionName(SizeDistribution sizes) {
+    switch (sizes) {
+        case SIZES_UNIFORM: return "uniform";
+        case SIZES_MIXED: return "mixed";
+        case SIZES_SKEWED: return "skewed";
+    }
+    return "?";
+}
+
+struct SceneParams {
+    int triangleCount;
+    SizeDistribution sizes;
+    float depthComplexity;   // Average number of triangles covering a pixel
+    float texturedFraction;  // Share of the triangles that sample a texture
+};
+
+struct Resolution {
+    int width, height;
+};
+
+struct Options {
+    int frames = 60;
+    int warmup = 5;
+    int framesInFlight = 2;
+    bool profile = true;
+    bool quick = false;
+    std::vector<Resolution> resolutions;
+    std::string jsonPath;
+    std::string csvPath;
+};
+
+struct Result {
+    Resolution resolution;
+    SceneParams scene;
+    TileConfig tiles;
+    int frames = 0;
+    double meanMs = 0.0, p50Ms = 0.0, p90Ms = 0.0, p99Ms = 0.0, maxMs = 0.0;
+    double trianglesPerSecond = 0.0;
+    double pixelsPerSecond = 0.0;        // Screen pixels per second
+    double shadedPixelsPerSecond = 0.0;  // Depth tests passed per second, from the frame stats
+    std::optional<FrameStats> stats;
+    FrameTimings stageAverage;           // Zero without profiling
+    size_t peakDeviceBytes = 0;          // All device memory the library had allocated, at its highest
+    uint64_t timedAllocations = 0;       // Device allocations during the timed frames - should be 0 once warmed up
+};
+
+uint64_t totalDeviceAllocations() {
+    uint64_t total = 0;
+    for (int i = 0; i < lr::MEM_CATEGORY_COUNT; i++) total += lr::memory::stats((lr::MemoryCategory)i).totalAllocations;
+    return total;
+}
+
+// Mean triangle area in pixels so that count triangles cover the screen depthComplexity times
+float meanTriangleArea(const SceneParams& scene, Resolution resolution) {
+    return scene.depthComplexity * resolution.width * resolution.height / scene.triangleCount;
+}
+
+float sampleArea(std::mt19937& rng, SizeDistribution sizes, float mean) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    switch (sizes) {
+        case SIZES_UNIFORM:
+            return mean;
+        case SIZES_MIXED: {
+            // Log-uniform on [mean/16, 4*mean] has mean (4 - 1/16) / ln(64) * mean
+            const float low = 1.0f / 16.0f, high = 4.0f;
+            float scale = std::log(high / low) / (high - low);
+            return mean * scale * low * std::pow(high / low, unit(rng));
+        }
+        case SIZES_SKEWED:
+            // 0.9 * mean/10 + 0.1 * 9.1*mean = mean
+            return unit(rng) < 0.9f ? mean * 0.1f : mean * 9.1f;
+    }
+    return mean;
+}
+
+Texture makeCheckerTexture() {
+    const int size = 64;
+    std::vector<uint32_t> pixels(size * size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            pixels[y * size + x] = ((x / 8 + y / 8) % 2) ? fromRgb(230, 230, 230) : fromRgb(40, 90, 160);
+        }
+    }
+    return Texture(size, size, pixels);
+}
+
+// Random triangles placed in screen space and unprojected at random depths in front of the camera,
+// split into a plain and a textured mesh
+struct SyntheticScene {
+    std::optional<Mesh> plain;
+    std::optional<Mesh> textured;
+    int triangleCount = 0;
+
+    SyntheticScene(const SceneParams& params, Resolution resolution, const Texture& texture) {
+        std::mt19937 rng(12345 + params.triangleCount);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        float mean = meanTriangleArea(params, resolution);
+
+        int texturedCount = (int)std::lround(params.triangleCount * params.texturedFraction);
+        std::vector<vec> vertices[2];
+        std::vector<int> indices[2], colors[2];
+        std::vector<TexCoord> texCoords;
+
+        for (int i = 0; i < params.triangleCount; i++) {
+            bool isTextured = i < texturedCount;
+            int mesh = isTextured ? 1 : 0;
+
+            // Equilateral triangle of the sampled area, centered anywhere on the screen
+            float area = sampleArea(rng, params.sizes, mean);
+            float radius = std::sqrt(area * 4.0f / (3.0f * std::sqrt(3.0f)));
+            float centerX = (unit(rng) - 0.5f) * resolution.width;
+            float centerY = (unit(rng) - 0.5f) * resolution.height;
+            float angle = unit(rng) * 6.2831853f;
+            float z = 100.0f + 1900.0f * unit(rng);
+            float unproject = z / SCR_Z;
+
+            int first = (int)vertices[mesh].size();
+            for (int corner = 0; corner < 3; corner++) {
+                float a = angle + corner * 2.0943951f;
+                vertices[mesh].push_back(vec((centerX + radius * std::cos(a)) * unproject,
+                                             (centerY + radius * std::sin(a)) * unproject, z));
+                indices[mesh].push_back(first + corner);
+            }
+            colors[mesh].push_back(fromRgb(55 + rng() % 200, 55 + rng() % 200, 55 + rng() % 200));
+            if (isTextured) {
+                texCoords.push_back(TexCoord(0.0f, 0.0f));
+                texCoords.push_back(TexCoord(1.0f, 0.0f));
+                texCoords.push_back(TexCoord(0.5f, 1.0f));
+            }
+        }
+
+        if (!indices[0].empty()) plain.emplace(vertices[0], indices[0], colors[0]);
+        if (!indices[1].empty()) textured.emplace(vertices[1], indices[1], colors[1], texCoords, texture);
+        triangleCount = params.triangleCount;
+    }
+};
+
+void renderFrame(Renderer& renderer, const SyntheticScene& scene) {
+    renderer.startNewFrame();
+    renderer.clear();
+    if (scene.plain) renderer.submitMesh(*scene.plain);
+    if (scene.textured) renderer.submitMesh(*scene.textured);
+    renderer.executeBinningPass();
+    renderer.executeFinishFrameTileBased();
+    renderer.finishFrame();
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = (size_t)std::min<double>(sorted.size() - 1, std::ceil(p * sorted.size()) - 1);
+    return sorted[index];
+}
+
+Result runScene(Renderer& renderer, Resolution resolution, const SceneParams& params,
+                const Texture& texture, const Options& options) {
+    SyntheticScene scene(params, resolution, texture);
+    Result result;
+    result.resolution = resolution;
+    result.scene = params;
+    result.tiles = renderer.getTileConfig();
+    result.frames = options.frames;
+
+    lr::memory::resetPeaks();
+    // Counted frames run with atomics in the kernels - only sample the warmup
+    renderer.setFrameStatsInterval(1);
+    for (int i = 0; i < options.warmup; i++) renderFrame(renderer, scene);
+    result.stats = renderer.getFrameStats();
+    renderer.setFrameStatsInterval(0);
+    // Flush the counted frames still in flight out of the timings
+    for (int i = 0; i < options.framesInFlight; i++) renderFrame(renderer, scene);
+
+    // Time between consecutive finishFrame returns - with frames in flight that's the throughput
+    std::vector<double> frameMs;
+    frameMs.reserve(options.frames);
+    FrameTimings stageTotal;
+    uint64_t allocationsBefore = totalDeviceAllocations();
+    auto previous = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.frames; i++) {
+        renderFrame(renderer, scene);
+        auto now = std::chrono::steady_clock::now();
+        frameMs.push_back(std::chrono::duration<double, std::milli>(now - previous).count());
+        previous = now;
+
+        // The renderer's own average spans 60 frames, which may reach back into the warmup
+        FrameTimings last = renderer.getFrameTimings().last;
+        stageTotal.clear += last.clear;
+        stageTotal.upload += last.upload;
+        stageTotal.transform += last.transform;
+        stageTotal.binning += last.binning;
+        stageTotal.render += last.render;
+        stageTotal.readback += last.readback;
+    }
+    result.timedAllocations = totalDeviceAllocations() - allocationsBefore;
+    result.peakDeviceBytes = lr::memory::peakBytes();
+    int n = options.frames;
+    result.stageAverage = {stageTotal.clear / n, stageTotal.upload / n, stageTotal.transform / n,
+                           stageTotal.binning / n, stageTotal.render / n, stageTotal.readback / n};
+
+    double totalMs = 0.0;
+    for (double ms : frameMs) totalMs += ms;
+    std::sort(frameMs.begin(), frameMs.end());
+    result.meanMs = totalMs / frameMs.size();
+    result.p50Ms = percentile(frameMs, 0.50);
+    result.p90Ms = percentile(frameMs, 0.90);
+    result.p99Ms = percentile(frameMs, 0.99);
+    result.maxMs = frameMs.back();
+
+    double framesPerSecond = 1000.0 / result.meanMs;
+    result.trianglesPerSecond = scene.triangleCount * framesPerSecond;
+    result.pixelsPerSecond = (double)resolution.width * resolution.height * framesPerSecond;
+    if (result.stats) result.shadedPixelsPerSecond = result.stats->pixelsWritten * framesPerSecond;
+    return result;
+}
+
+std::vector<SceneParams> sceneSweep(bool quick) {
+    std::vector<int> counts = quick ? std::vector<int>{1000, 100000} : std::vector<int>{1000, 10000, 100000};
+    std::vector<SizeDistribution> sizes = quick ? std::vector<SizeDistribution>{SIZES_UNIFORM}
+                                                : std::vector<SizeDistribution>{SIZES_UNIFORM, SIZES_MIXED, SIZES_SKEWED};
+    std::vector<SceneParams> scenes;
+    for (int count : counts) {
+        for (SizeDistribution size : sizes) {
+            for (float depth : {1.0f, 4.0f}) {
+                for (float textured : {0.0f, 0.5f}) {
+                    scenes.push_back({count, size, depth, textured});
+                }
+            }
+        }
+    }
+    return scenes;
+}
+
+double ms(uint64_t nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+void writeJson(const std::string& path, const std::vector<Result>& results, bool profiling, int framesInFlight) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LOG_ERR("Can't write " + path);
+        return;
+    }
+    cl::Device& device = getGPU().getDevice();
+    file << "{\n  \"device\": \"" << device.getInfo<CL_DEVICE_NAME>() << "\",\n"
+         << "  \"driver\": \"" << device.getInfo<CL_DRIVER_VERSION>() << "\",\n"
+         << "  \"profiling\": " << (profiling ? "true" : "false") << ",\n"
+         << "  \"frames_in_flight\": " << framesInFlight << ",\n"
+         << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        file << (i ? ",\n" : "\n")
+             << "    {\"width\": " << r.resolution.width << ", \"height\": " << r.resolution.height
+             << ", \"triangles\": " << r.scene.triangleCount
+             << ", \"size_distribution\": \"" << sizeDistributionName(r.scene.sizes) << "\""
+             << ", \"depth_complexity\": " << r.scene.depthComplexity
+             << ", \"textured_fraction\": " << r.scene.texturedFraction
+             << ", \"tile_size\": " << r.tiles.tileSize
+             << ", \"local_size\": [" << r.tiles.localX << ", " << r.tiles.localY << "]"
+             << ", \"frames\": " << r.frames
+             << ",\n     \"frame_ms\": {\"mean\": " << r.meanMs << ", \"p50\": " << r.p50Ms << ", \"p90\": " << r.p90Ms
+             << ", \"p99\": " << r.p99Ms << ", \"max\": " << r.maxMs << "}"
+             << ", \"triangles_per_s\": " << r.trianglesPerSecond
+             << ", \"pixels_per_s\": " << r.pixelsPerSecond
+             << ", \"shaded_pixels_per_s\": " << r.shadedPixelsPerSecond
+             << ", \"peak_device_bytes\": " << r.peakDeviceBytes
+             << ", \"timed_device_allocations\": " << r.timedAllocations;
+        if (profiling) {
+            const FrameTimings& t = r.stageAverage;
+            file << ",\n     \"stage_ms\": {\"clear\": " << ms(t.clear) << ", \"upload\": " << ms(t.upload)
+                 << ", \"transform\": " << ms(t.transform) << ", \"binning\": " << ms(t.binning)
+                 << ", \"render\": " << ms(t.render) << ", \"readback\": " << ms(t.readback) << "}";
+        }
+        if (r.stats) {
+            const FrameStats& s = *r.stats;
+            file << ",\n     \"stats\": {\"culled_near\": " << s.culledNear << ", \"culled_degenerate\": " << s.culledDegenerate
+                 << ", \"culled_offscreen\": " << s.culledOffscreen << ", \"bin_entries\": " << s.binEntries
+                 << ", \"bin_overflows\": " << s.binOverflows << ", \"pixels_tested\": " << s.pixelsTested
+                 << ", \"pixels_written\": " << s.pixelsWritten << "}";
+        }
+        file << "}";
+    }
+    file << "\n  ]\n}\n";
+    LOG_SUCCESS("Wrote " + path);
+}
+
+void writeCsv(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LOG_ERR("Can't write " + path);
+        return;
+    }
+    file << "width,height,triangles,size_distribution,depth_complexity,textured_fraction,tile_size,local_x,local_y,frames,"
+            "mean_ms,p50_ms,p90_ms,p99_ms,max_ms,triangles_per_s,pixels_per_s,shaded_pixels_per_s,"
+            "clear_ms,upload_ms,transform_ms,binning_ms,render_ms,readback_ms,pixels_tested,pixels_written,"
+            "peak_device_bytes,timed_device_allocations\n";
+    for (const Result& r : results) {
+        const FrameTimings& t = r.stageAverage;
+        file << r.resolution.width << ',' << r.resolution.height << ',' << r.scene.triangleCount << ','
+             << sizeDistributionName(r.scene.sizes) << ',' << r.scene.depthComplexity << ',' << r.scene.texturedFraction << ','
+             << r.tiles.tileSize << ',' << r.tiles.localX << ',' << r.tiles.localY << ',' << r.frames << ','
+             << r.meanMs << ',' << r.p50Ms << ',' << r.p90Ms << ',' << r.p99Ms << ',' << r.maxMs << ','
+             << r.trianglesPerSecond << ',' << r.pixelsPerSecond << ',' << r.shadedPixelsPerSecond << ','
+             << ms(t.clear) << ',' << ms(t.upload) << ',' << ms(t.transform) << ',' << ms(t.binning) << ','
+             << ms(t.render) << ',' << ms(t.readback) << ','
+             << (r.stats ? r.stats->pixelsTested : 0) << ',' << (r.stats ? r.stats->pixelsWritten : 0) << ','
+             << r.peakDeviceBytes << ',' << r.timedAllocations << '\n';
+    }
+    LOG_SUCCESS("Wrote " + path);
+}
+
+void printUsage() {
+    std::printf("usage: bench_renderer [--frames N] [--warmup N] [--resolution WxH]... [--quick]\n"
+                "                      [--frames-in-flight N] [--json FILE] [--csv FILE] [--no-profile]\n");
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--frames" && hasValue) options.frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && hasValue) options.warmup = std::max(2, std::atoi(argv[++i]));  // The first frame comes back on the second call
+        else if (arg == "--frames-in-flight" && hasValue) options.framesInFlight = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--json" && hasValue) options.jsonPath = argv[++i];
+        else if (arg == "--csv" && hasValue) options.csvPath = argv[++i];
+        else if (arg == "--quick") options.quick = true;
+        else if (arg == "--no-profile") options.profile = false;
+        else if (arg == "--resolution" && hasValue) {
+            Resolution resolution;
+            if (std::sscanf(argv[++i], "%dx%d", &resolution.width, &resolution.height) != 2 ||
+                resolution.width <= 0 || resolution.height <= 0) {
+                std::printf("bad resolution '%s'\n", argv[i]);
+                return false;
+            }
+            options.resolutions.push_back(resolution);
+        } else {
+            printUsage();
+            return false;
+        }
+    }
+    // The first frame comes back on call framesInFlight, the warmup has to reach it for the stats
+    options.warmup = std::max(options.warmup, options.framesInFlight);
+    if (options.resolutions.empty()) {
+        if (options.quick) options.resolutions = {{1280, 720}};
+        else options.resolutions = {{640, 480}, {1280, 720}, {1920, 1080}};
+    }
+    if (options.jsonPath.empty() && options.csvPath.empty()) options.jsonPath = "bench_renderer.json";
+    return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+    LOG_INIT();
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    DeviceSelection selection = DeviceSelection::fromEnvironment();
+    selection.profiling |= options.profile;
+    initGPU(selection);
+    bool profiling = getGPU().isProfiling();
+    LOG_INFO("Benchmarking on " + getGPU().getDevice().getInfo<CL_DEVICE_NAME>());
+
+    Texture texture = makeCheckerTexture();
+    std::vector<SceneParams> scenes = sceneSweep(options.quick);
+    std::vector<Result> results;
+
+    std::printf("%-10s %8s %-8s %5s %5s %9s %9s %9s %12s %12s\n",
+                "resolution", "tris", "sizes", "depth", "tex", "mean ms", "p50 ms", "p99 ms", "Mtris/s", "Mpix/s");
+    for (Resolution resolution : options.resolutions) {
+        // One frame in flight serializes the CPU and the device - the default measures the pipelined throughput
+        Renderer renderer(resolution.width, resolution.height, SCR_Z, options.framesInFlight);
+        for (const SceneParams& params : scenes) {
+            Result result = runScene(renderer, resolution, params, texture, options);
+            std::printf("%4dx%-5d %8d %-8s %5.1f %5.2f %9.3f %9.3f %9.3f %12.2f %12.1f\n",
+                        resolution.width, resolution.height, params.triangleCount, sizeDistributionName(params.sizes),
+                        params.depthComplexity, params.texturedFraction, result.meanMs, result.p50Ms, result.p99Ms,
+                        result.trianglesPerSecond / 1e6, result.pixelsPerSecond / 1e6);
+            results.push_back(result);
+        }
+    }
+
+    LOG_INFO("Device memory:\n" + lr::memory::report());
+    if (!options.jsonPath.empty()) writeJson(options.jsonPath, results, profiling, options.framesInFlight);
+    if (!options.csvPath.empty()) writeCsv(options.csvPath, results);
+
+    deleteGPU();
+    return 0;
+}
@@ -0,0 +1,13 @@
+# Concatenates the OpenCL kernel sources in order into one file for the offline compiler,
+# the same way the renderer combines them at runtime.
+# Usage: cmake -DOUTPUT=<file> -DSOURCES=<file1|file2|...> -P CombineKernels.cmake
+
+string(REPLACE "|" ";" SOURCES "${SOURCES}")
+
+set(content "")
+foreach(source ${SOURCES})
+    file(READ ${source} code)
+    string(APPEND content "${code}\n\n")
+endforeach()
+
+file(WRITE ${OUTPUT} "${content}")
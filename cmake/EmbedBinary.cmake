@@ -0,0 +1,14 @@
+# Writes a binary file (the offline-compiled SPIR-V kernels) into a C++ header as a byte array.
+# Usage: cmake -DINPUT=<file> -DOUTPUT=<header> -DSYMBOL=<name> -P EmbedBinary.cmake
+
+file(READ ${INPUT} hex HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+# Break the initializer into lines of 16 bytes
+string(REGEX REPLACE "((0x..,){16})" "\\1\n    " bytes "${bytes}")
+
+string(TOUPPER ${SYMBOL} guard)
+file(WRITE ${OUTPUT}
+    "// Generated by cmake/EmbedBinary.cmake - do not edit\n"
+    "#ifndef ${guard}_HPP\n#define ${guard}_HPP\n\n"
+    "inline constexpr unsigned char ${SYMBOL}[] = {\n    ${bytes}\n};\n\n"
+    "#endif // ${guard}_HPP\n")
@@ -0,0 +1,25 @@
+# Writes the OpenCL kernel sources into a C++ header as raw string literals.
+# Usage: cmake -DOUTPUT=<header> -DSOURCES=<file1|file2|...> -P EmbedKernels.cmake
+
+string(REPLACE "|" ";" SOURCES "${SOURCES}")
+
+set(content "// Generated by cmake/EmbedKernels.cmake - do not edit\n")
+string(APPEND content "#ifndef LR_KERNELS_HPP\n#define LR_KERNELS_HPP\n\n")
+string(APPEND content "struct EmbeddedKernelSource {\n    const char* name;\n    const char* code;\n};\n\n")
+string(APPEND content "inline constexpr EmbeddedKernelSource embeddedKernelSources[] = {\n")
+
+foreach(source ${SOURCES})
+    get_filename_component(name ${source} NAME)
+    file(READ ${source} code)
+    string(APPEND content "    {\"${name}\", R\"lrcl(${code})lrcl\"},\n")
+endforeach()
+
+string(APPEND content "};\n\n#endif // LR_KERNELS_HPP\n")
+
+# Only touch the header if something changed, so dependent sources aren't rebuilt needlessly
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+endif()
+if(NOT "${previous}" STREQUAL "${content}")
+    file(WRITE ${OUTPUT} "${content}")
+endif()
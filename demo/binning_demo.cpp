@@ -13,6 +13,7 @@ int main() {
         
         int screen_width = 800, screen_height = 600;
         Renderer renderer(screen_width, screen_height, 1000);
+        renderer.setFrameStatsInterval(1);  // Count every frame
         
         LOG_SUCCESS("GPU and Renderer initialized successfully");
         
@@ -86,9 +87,20 @@ int main() {
         // Traditional indexed drawing methods have been removed - only binning system now
         
         // Finish the frame
+        // With frames in flight the first call has no finished frame yet - wait for this one
         uint32_t* framebuffer = renderer.finishFrame();
+        if (!framebuffer) framebuffer = renderer.finishPendingFrame();
         LOG_SUCCESS("Frame completed - framebuffer ready");
         
+        if (std::optional<FrameStats> stats = renderer.getFrameStats()) {
+            LOG_INFO("Frame stats: " + std::to_string(stats->submitted) + " submitted, " +
+                     std::to_string(stats->culledNear) + " near-culled, " +
+                     std::to_string(stats->culledDegenerate) + " degenerate, " +
+                     std::to_string(stats->culledOffscreen) + " offscreen, " +
+                     std::to_string(stats->binEntries) + " tile entries (" + std::to_string(stats->binOverflows) + " dropped), " +
+                     std::to_string(stats->pixelsTested) + " pixels tested, " + std::to_string(stats->pixelsWritten) + " written");
+        }
+        
         LOG_SUCCESS("Binning Demo completed successfully!");
         LOG_INFO("Both binning and tile-based rendering are now working!");
         LOG_INFO("Tile-based rendering uses binned triangle data for efficient GPU processing");
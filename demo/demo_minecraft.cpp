@@ -161,8 +161,11 @@ int main(){
         {1,1,1,1,1},
     };
 
-    // Create all dirt blocks based on terrain map
-    std::vector<Shape3D> dirtBlocks;
+    // All dirt blocks share one mesh - every block is just an instance placed by the terrain map
+    Shape3D dirtBlockShape = createMinecraftDirtBlock(blockSize);
+    dirtBlockShape.texture = dirtTexture;
+    Mesh dirtBlockMesh = createMesh(dirtBlockShape);
+    std::vector<Transform> dirtBlocks;
     
     for (int z = 0; z < terrainDepth; z++) {
         for (int x = 0; x < terrainWidth; x++) {
@@ -170,9 +173,6 @@ int main(){
             
             // Create stacked blocks for this position
             for (int y = 0; y < height; y++) {
-                Shape3D dirtBlock = createMinecraftDirtBlock(blockSize);
-                dirtBlock.texture = dirtTexture;
-                
                 // Position the block in world space
                 vec blockPos = {
                     (x - terrainWidth/2.0f) * blockSize,   // Center the terrain on X axis
@@ -180,12 +180,7 @@ int main(){
                     (z - terrainDepth/2.0f) * blockSize    // Center the terrain on Z axis
                 };
                 
-                // Apply position to all vertices
-                for (auto &v : dirtBlock.vertices) {
-                    v = v + blockPos;
-                }
-                
-                dirtBlocks.push_back(dirtBlock);
+                dirtBlocks.push_back(Transform(blockPos));
             }
         }
     }
@@ -255,22 +250,34 @@ int main(){
         renderer.clear();     
 
         // Draw all the dirt blocks in the terrain (submits to binning)
-        for (const auto& dirtBlock : dirtBlocks) {
-            drawTexturedShape(renderer, dirtBlock);
-        }
+        renderer.submitInstances(dirtBlockMesh, dirtBlocks);
 
         // Execute binning pass and tile-based rendering
         renderer.executeBinningPass();
         renderer.executeFinishFrameTileBased();
-        Uint32* colorBuffer = renderer.finishFrame();
-
-        SDL_UpdateTexture(texture, NULL, colorBuffer, screenWidth * sizeof(Uint32));
-        SDL_RenderCopy(sdlRenderer, texture, NULL, NULL);
+        // Straight into the streaming texture - no intermediate copy
+        void* pixels;
+        int pitch;
+        SDL_LockTexture(texture, NULL, &pixels, &pitch);
+        bool hasFrame = renderer.finishFrame((uint32_t*)pixels, pitch / sizeof(Uint32));
+        SDL_UnlockTexture(texture);
+        // The first frame only comes back on the next call - until then the texture holds garbage
+        if (hasFrame) SDL_RenderCopy(sdlRenderer, texture, NULL, NULL);
 
         drawText("Move with WASD", 100,100,sdlRenderer);
         drawText("Move up/down with SPACE / C", 100,150,sdlRenderer);
         drawText("Look around with mouse", 100,200,sdlRenderer);
         drawText("Press P to take a screenshot", 100,250,sdlRenderer);
+
+        // Device time per stage, averaged - only measured with LR_PROFILE=1
+        FrameTimingReport timings = renderer.getFrameTimings();
+        if (timings.frameCount > 0) {
+            char line[128];
+            snprintf(line, sizeof(line), "GPU %.2f ms (binning %.2f, tiles %.2f, readback %.2f)",
+                     timings.average.total() / 1e6, timings.average.binning / 1e6,
+                     timings.average.render / 1e6, timings.average.readback / 1e6);
+            drawText(line, 100,350,sdlRenderer);
+        }
         drawText("Terrain blocks: " + std::to_string(dirtBlocks.size()), 100,300,sdlRenderer);
 
         SDL_RenderPresent(sdlRenderer);
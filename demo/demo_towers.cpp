@@ -133,6 +133,7 @@ int main(){
 
     const int nTowers = 12;
 
+    TowerMeshes towerMeshes(300.0f);
     std::vector<Tower> towers;
     towers.reserve(nTowers);
 
@@ -141,7 +142,7 @@ int main(){
         float z = float((rand() % 16001) + 8000);
         vec towerPos = {x, -100.0f, z};
 
-        Tower t(275.0f, 450.0f + float(rand()%551), 300.0f, 300.0f, 0.01f, towerPos);
+        Tower t(275.0f, 450.0f + float(rand()%551), 300.0f, 0.01f, towerPos);
         towers.push_back(t);
     }
     
@@ -208,22 +209,36 @@ int main(){
         // Draw all towers (submits to binning)
         for (auto &tower : towers) {
             tower.update();
-            tower.draw(renderer);
         }
+        drawTowers(renderer, towerMeshes, towers);
         
         // Execute binning pass and tile-based rendering
         renderer.executeBinningPass();
         renderer.executeFinishFrameTileBased();
-        Uint32* colorBuffer = renderer.finishFrame();
-
-        SDL_UpdateTexture(texture, NULL, colorBuffer, screenWidth * sizeof(Uint32));
-        SDL_RenderCopy(sdlRenderer, texture, NULL, NULL);
+        // Straight into the streaming texture - no intermediate copy
+        void* pixels;
+        int pitch;
+        SDL_LockTexture(texture, NULL, &pixels, &pitch);
+        bool hasFrame = renderer.finishFrame((uint32_t*)pixels, pitch / sizeof(Uint32));
+        SDL_UnlockTexture(texture);
+        // The first frame only comes back on the next call - until then the texture holds garbage
+        if (hasFrame) SDL_RenderCopy(sdlRenderer, texture, NULL, NULL);
 
         drawText("Move with WASD", 100,100,sdlRenderer);
         drawText("Move up/down with SPACE / C", 100,150,sdlRenderer);
         drawText("Look around with mouse", 100,200,sdlRenderer);
         drawText("Press P to take a screenshot", 100,250,sdlRenderer);
 
+        // Device time per stage, averaged - only measured with LR_PROFILE=1
+        FrameTimingReport timings = renderer.getFrameTimings();
+        if (timings.frameCount > 0) {
+            char line[128];
+            snprintf(line, sizeof(line), "GPU %.2f ms (binning %.2f, tiles %.2f, readback %.2f)",
+                     timings.average.total() / 1e6, timings.average.binning / 1e6,
+                     timings.average.render / 1e6, timings.average.readback / 1e6);
+            drawText(line, 100,300,sdlRenderer);
+        }
+
         SDL_RenderPresent(sdlRenderer);
 
         // Cap framerate
@@ -0,0 +1,49 @@
+#include "../include/rendering.hpp"
+#include "../include/render_target.hpp"
+#include "../include/mesh.hpp"
+#include "../include/log.hpp"
+#include "../include/util.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Renders a spinning ring of quads without a window and writes every frame to an image file.
+//   headless_demo [frames] [path pattern]     e.g. headless_demo 120 out/frame_%04d.png
+// There's no frame-rate cap - frames are rendered as fast as the device and the disk allow.
+int main(int argc, char** argv) {
+    LOG_INIT();
+    int frames = argc > 1 ? std::atoi(argv[1]) : 60;
+    std::string pattern = argc > 2 ? argv[2] : "frame_%04d.ppm";
+
+    initGPU();
+    const int screenWidth = 800, screenHeight = 600;
+    Renderer renderer(screenWidth, screenHeight, 1000);
+
+    const vec vertices[] = {{-0.5f, -0.5f, 0.0f}, {0.5f, -0.5f, 0.0f}, {0.5f, 0.5f, 0.0f}, {-0.5f, 0.5f, 0.0f}};
+    const int indices[] = {0, 1, 2, 0, 2, 3};
+    const int colors[] = {fromRgb(220, 120, 40), fromRgb(40, 120, 220)};
+    Mesh quad(vertices, indices, colors);
+
+    ImageFileTarget target(pattern);
+    std::vector<Transform> instances;
+    for (int frame = 0; frame < frames; frame++) {
+        instances.clear();
+        for (int i = 0; i < 24; i++) {
+            float angle = i * 0.2618f + frame * 0.02f;
+            instances.push_back(Transform(vec(300.0f * std::cos(angle), 300.0f * std::sin(angle), 900.0f + 200.0f * std::sin(angle * 3)),
+                                          vec(120.0f, 120.0f, 1.0f), angle * 2));
+        }
+        renderer.startNewFrame();
+        renderer.clear();
+        renderer.submitInstances(quad, instances);
+        renderer.executeBinningPass();
+        renderer.executeFinishFrameTileBased();
+        renderer.finishFrame(target);
+    }
+    int pending = renderer.finishPendingFrames(target);
+    LOG_SUCCESS("Wrote " + std::to_string(frames) + " frames (" + std::to_string(pending) + " flushed at the end)");
+
+    deleteGPU();
+    return 0;
+}
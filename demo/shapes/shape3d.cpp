@@ -1,4 +1,5 @@
 #include "shape3d.hpp"
+#include "../include/trace.hpp"
 #include <cmath>       
 #include <cstdlib>         
 
@@ -22,6 +23,7 @@ void drawShape(
     Renderer& renderer,
     const Shape3D& shape)
 {
+    TRACE_SCOPE("drawShape");
     // Apply camera transformations to all vertices
     std::vector<vec> transformedVertices;
     transformedVertices.reserve(shape.vertices.size());
@@ -31,8 +33,8 @@ void drawShape(
         transformedVertices.push_back(camera.transformVertex(vertex));
     }
     
-    // Create vertex buffer from camera-transformed vertices
-    lr::AllPurposeBuffer<vec> vertexBuffer(transformedVertices.size(), transformedVertices);
+    // The camera-transformed vertices go to the device with all other shapes of the frame in one upload
+    lr::BufferRange<vec> vertexBuffer = renderer.streamVertices(transformedVertices);
     
     // Submit each face triangle for binning
     for (size_t i = 0; i < shape.faces.size(); i++) {
@@ -48,6 +50,7 @@ void drawTexturedShape(
     Renderer& renderer,
     const Shape3D& shape)
 {
+    TRACE_SCOPE("drawTexturedShape");
     // Only proceed if texture is available
     if (!shape.texture.has_value()) {
         return;
@@ -62,8 +65,8 @@ void drawTexturedShape(
         transformedVertices.push_back(camera.transformVertex(vertex));
     }
     
-    // Create vertex buffer from camera-transformed vertices
-    lr::AllPurposeBuffer<vec> vertexBuffer(transformedVertices.size(), transformedVertices);
+    // The camera-transformed vertices go to the device with all other shapes of the frame in one upload
+    lr::BufferRange<vec> vertexBuffer = renderer.streamVertices(transformedVertices);
     
     // Submit each face triangle for binning
     for (size_t i = 0; i < shape.faces.size(); i++) {
@@ -88,6 +91,19 @@ void drawTexturedShape(
     }
 }
 
+Mesh createMesh(const Shape3D& shape)
+{
+    std::vector<int> indices;
+    indices.reserve(shape.faces.size() * 3);
+    for (const Face& face : shape.faces) {
+        indices.push_back(face.v0);
+        indices.push_back(face.v1);
+        indices.push_back(face.v2);
+    }
+
+    return Mesh(shape.vertices, indices, shape.faceColors, shape.texCoords, shape.texture);
+}
+
 Shape3D createPyramid(int N, float radius, float height, int color)
 {
     Shape3D pyramid;
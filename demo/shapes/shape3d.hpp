@@ -6,6 +6,7 @@
 #include "../include/util.hpp"    
 #include "../include/texture.hpp" // Include texture.hpp directly
 #include "../include/rendering.hpp" // Include for Renderer 
+#include "../include/mesh.hpp"
 
 struct Face {
     int v0, v1, v2;
@@ -39,4 +40,7 @@ void drawTexturedShape(
 
 Shape3D createMinecraftDirtBlock(float size);
 
+// Upload a Shape3D to the GPU once - draw it every frame with renderer.submitMesh()
+Mesh createMesh(const Shape3D& shape);
+
 #endif // SHAPE3D_HPP
@@ -3,31 +3,34 @@
 
 #include "shape3d.hpp"
 
+// Geometry shared by all towers. The parts are built with unit height and
+// every tower scales them to its own heights, so all towers are instances of three meshes.
+struct TowerMeshes {
+    Mesh basePrism;
+    Mesh hexPrism;
+    Mesh hexPyramid;
+
+    TowerMeshes(float radius)
+        : basePrism(createMesh(createPrism(5, radius * 1.4f, 1.0f, fromRgb(100,100,100)))),
+          hexPrism(createMesh(createPrism(10, radius, 1.0f, fromRgb(51,51,51)))),
+          hexPyramid(createMesh(createPyramid(10, radius, 1.0f, fromRgb(100,50,50))))
+    {}
+};
+
 struct Tower {
-    Shape3D basePrism;
-    Shape3D hexPrism;
-    Shape3D hexPyramid;
+    Transform basePrism;
+    Transform hexPrism;
+    Transform hexPyramid;
     float rotationSpeed;  
     vec position;
 
     Tower(float basePrismHeight, float prismHeight, float pyramidHeight,
-          float radius, float spinSpeed, const vec& pos)
+          float spinSpeed, const vec& pos)
         : rotationSpeed(spinSpeed), position(pos)
     {
-        basePrism = createPrism(5, radius * 1.4f, basePrismHeight, fromRgb(100,100,100));
-        hexPrism   = createPrism(10,radius, prismHeight, fromRgb(51,51,51));
-        hexPyramid = createPyramid(10,radius, pyramidHeight, fromRgb(100,50,50));
-
-        for (auto &v : hexPrism.vertices) {
-            v.y += basePrismHeight + 1;
-        }
-        for (auto &v : hexPyramid.vertices) {
-            v.y += (basePrismHeight + prismHeight + 1);
-        }
-
-        for (auto &v : basePrism.vertices)  { v = v + pos; }
-        for (auto &v : hexPrism.vertices)    { v = v + pos; }
-        for (auto &v : hexPyramid.vertices)  { v = v + pos; }
+        basePrism  = Transform(pos, vec(1.0f, basePrismHeight, 1.0f));
+        hexPrism   = Transform(pos + vec(0.0f, basePrismHeight + 1, 0.0f), vec(1.0f, prismHeight, 1.0f));
+        hexPyramid = Transform(pos + vec(0.0f, basePrismHeight + prismHeight + 1, 0.0f), vec(1.0f, pyramidHeight, 1.0f));
     }
 
     void update() {
@@ -41,13 +44,24 @@ struct Tower {
             v = rotY(v, position, rotationSpeed);
         }*/
     }
+};
 
-    void draw(Renderer& renderer)
-    {
-        drawShape(renderer, basePrism);
-        drawShape(renderer, hexPrism);
-        drawShape(renderer, hexPyramid);
+// Draws every tower with one instanced submission per part
+inline void drawTowers(Renderer& renderer, const TowerMeshes& meshes, const std::vector<Tower>& towers)
+{
+    std::vector<Transform> basePrisms, hexPrisms, hexPyramids;
+    basePrisms.reserve(towers.size());
+    hexPrisms.reserve(towers.size());
+    hexPyramids.reserve(towers.size());
+    for (const Tower& tower : towers) {
+        basePrisms.push_back(tower.basePrism);
+        hexPrisms.push_back(tower.hexPrism);
+        hexPyramids.push_back(tower.hexPyramid);
     }
-};
+
+    renderer.submitInstances(meshes.basePrism, basePrisms);
+    renderer.submitInstances(meshes.hexPrism, hexPrisms);
+    renderer.submitInstances(meshes.hexPyramid, hexPyramids);
+}
 
 #endif // TOWER_HPP
@@ -1,8 +1,12 @@
 #include <iostream>
 #include <vector>
 #include <span>
+#include <algorithm>
 #include "../include/rendering.hpp"
 #include "../include/buffer.hpp"
+#include "../include/device_pool.hpp"
+#include "../include/memory_tracker.hpp"
+#include "../include/render_target.hpp"
 #include "../include/log.hpp"
 
 using namespace lr;
@@ -167,10 +171,309 @@ int main() {
             }
         }
         
+        // Test 7: DynamicBuffer - capacity grows, contents in use survive the growth
+        LOG_INFO("=== Test 7: DynamicBuffer ===");
+        {
+            DynamicBuffer<int> buffer(4);
+            
+            std::vector<int> data = {1, 2, 3};
+            if (buffer.writeFrom(data)) {
+                LOG_ERR("DynamicBuffer reallocated although the data fit!");
+                return -1;
+            }
+            
+            // Growing past the capacity has to keep the elements in use
+            if (!buffer.resize(100) || buffer.capacity() < 100) {
+                LOG_ERR("DynamicBuffer didn't grow!");
+                return -1;
+            }
+            std::vector<int> readBack;
+            buffer.readTo(readBack);
+            if (readBack.size() != 100 || readBack[0] != 1 || readBack[1] != 2 || readBack[2] != 3) {
+                LOG_ERR("DynamicBuffer lost its contents while growing!");
+                return -1;
+            }
+            
+            // Smaller uploads reuse the allocation
+            size_t capacity = buffer.capacity();
+            std::vector<int> smaller = {7, 8};
+            if (buffer.writeFrom(smaller) || buffer.capacity() != capacity || buffer.size() != 2) {
+                LOG_ERR("DynamicBuffer reallocated for a smaller upload!");
+                return -1;
+            }
+            buffer.readTo(readBack);
+            if (readBack != smaller) {
+                LOG_ERR("DynamicBuffer data verification failed!");
+                return -1;
+            }
+            LOG_SUCCESS("DynamicBuffer test passed");
+        }
+        
+        // Test 8: Asynchronous transfers
+        LOG_INFO("=== Test 8: Asynchronous transfers ===");
+        {
+            AllPurposeBuffer<int> buffer(1000);
+            std::vector<int> first(1000), second(1000);
+            for (int i = 0; i < 1000; i++) {
+                first[i] = i;
+                second[i] = 3 * i;
+            }
+            
+            // Queued back to back, the second write waits for the first
+            cl::Event written = buffer.writeFromAsync(std::span<const int>(first));
+            std::vector<cl::Event> waitFor = {written};
+            std::vector<int> moved = second;
+            cl::Event overwritten = buffer.writeFromAsync(std::move(moved), &waitFor);
+            
+            std::vector<int> readBack(1000);
+            waitFor = {overwritten};
+            cl::Event read = buffer.readToAsync(std::span<int>(readBack), &waitFor);
+            read.wait();
+            if (readBack != second) {
+                LOG_ERR("Asynchronous transfer verification failed!");
+                return -1;
+            }
+            LOG_SUCCESS("Asynchronous transfer test passed");
+        }
+        
+        // Test 9: StreamingBuffer
+        LOG_INFO("=== Test 9: StreamingBuffer ===");
+        {
+            StreamingBuffer<int> stream(8, 2);
+            AllPurposeBuffer<int> check(20);
+            for (int frame = 0; frame < 4; frame++) {
+                stream.beginFrame();
+                // The last frames outgrow the 8-element segments
+                int count = frame < 2 ? 6 : 20;
+                std::vector<int> expected;
+                std::vector<BufferRange<int>> ranges;
+                for (int i = 0; i < count; i += 2) {
+                    std::vector<int> values = {frame * 100 + i, frame * 100 + i + 1};
+                    ranges.push_back(stream.allocate(std::span<const int>(values)));
+                    expected.insert(expected.end(), values.begin(), values.end());
+                }
+                stream.flush();
+                
+                // Ranges handed out before a growth point into the old buffer - copy each on its own
+                for (size_t i = 0; i < ranges.size(); i++) {
+                    gpuQueue().enqueueCopyBuffer(ranges[i].buffer, check.getCLBuffer(), sizeof(int) * ranges[i].offset, sizeof(int) * i * 2, sizeof(int) * 2);
+                }
+                std::vector<int> readBack;
+                check.readTo(readBack);
+                readBack.resize(count);
+                if (readBack != expected) {
+                    LOG_ERR("StreamingBuffer data verification failed in frame " + std::to_string(frame));
+                    return -1;
+                }
+            }
+            if (stream.frameCapacity() < 20) {
+                LOG_ERR("StreamingBuffer didn't grow");
+                return -1;
+            }
+            LOG_SUCCESS("StreamingBuffer test passed");
+        }
+        
+        // Test 10: DevicePool and FrameArena
+        LOG_INFO("=== Test 10: DevicePool and FrameArena ===");
+        {
+            DevicePool pool(64 << 10);
+            std::vector<int> values(100);
+            for (int i = 0; i < 100; i++) values[i] = i * 3;
+            cl_mem firstBlock;
+            {
+                AllPurposeBuffer<int> pooled(100, pool, std::span<const int>(values));
+                std::vector<int> readBack;
+                pooled.readTo(readBack);
+                if (readBack != values) {
+                    LOG_ERR("Pooled buffer data verification failed!");
+                    return -1;
+                }
+                firstBlock = pooled.getCLBuffer()();
+                if (pool.stats().blocksInUse != 1 || pool.stats().bytesInUse != 512) {
+                    LOG_ERR("DevicePool should have one 512 byte block in use");
+                    return -1;
+                }
+            }
+            // A freed block of the same size class comes back as it is - no new sub-buffer
+            AllPurposeBuffer<int> reused(80, pool);
+            if (reused.getCLBuffer()() != firstBlock || pool.stats().blocksInUse != 1) {
+                LOG_ERR("DevicePool didn't reuse the freed block");
+                return -1;
+            }
+            // The owner keeps a block from being reused
+            std::shared_ptr<const void> pin = reused.getAllocation();
+            AllPurposeBuffer<int> other(80, pool);
+            if (other.getCLBuffer()() == firstBlock) {
+                LOG_ERR("DevicePool reused a block that is still owned");
+                return -1;
+            }
+            AllPurposeBuffer<int> dedicated(64 << 10, pool);
+            if (pool.stats().dedicatedBytes != sizeof(int) * (64 << 10) || pool.stats().slabCount != 1) {
+                LOG_ERR("DevicePool should give big buffers their own allocation");
+                return -1;
+            }
+
+            FrameArena arena(256);
+            AllPurposeBuffer<int> check(100);
+            for (int frame = 0; frame < 2; frame++) {
+                arena.reset();
+                arena.allocate<char>(3);
+                // Outgrows the arena in the first frame and starts the new buffer, in the second
+                // it fits behind the chars, aligned for ints
+                BufferRange<int> range = arena.allocate<int>(100);
+                if (range.offset != (frame == 0 ? 0 : 1)) {
+                    LOG_ERR("FrameArena range has the wrong offset in frame " + std::to_string(frame));
+                    return -1;
+                }
+                gpuQueue().enqueueWriteBuffer(range.buffer, CL_TRUE, sizeof(int) * range.offset, sizeof(int) * 100, values.data());
+                gpuQueue().enqueueCopyBuffer(range.buffer, check.getCLBuffer(), sizeof(int) * range.offset, 0, sizeof(int) * 100);
+                std::vector<int> readBack;
+                check.readTo(readBack);
+                if (readBack != values) {
+                    LOG_ERR("FrameArena data verification failed in frame " + std::to_string(frame));
+                    return -1;
+                }
+            }
+            LOG_SUCCESS("DevicePool and FrameArena test passed");
+        }
+        
+        // Test 11: Memory tracking
+        LOG_INFO("=== Test 11: Memory tracking ===");
+        {
+            memory::CategoryStats before = memory::stats(MEM_BINNING);
+            size_t totalBefore = memory::currentBytes();
+            {
+                GPUOnlyBuffer<int> tracked(1000, MEM_BINNING);
+                GPUOnlyBuffer<int> shared = tracked;  // Copies share the registration
+                memory::CategoryStats during = memory::stats(MEM_BINNING);
+                if (during.currentBytes != before.currentBytes + 4000 || during.liveAllocations != before.liveAllocations + 1 ||
+                    memory::currentBytes() != totalBefore + 4000) {
+                    LOG_ERR("Memory tracker didn't register the buffer");
+                    return -1;
+                }
+            }
+            DynamicBuffer<int> growing(10, MEM_BINNING);
+            growing.resize(1000);
+            memory::CategoryStats after = memory::stats(MEM_BINNING);
+            if (after.currentBytes != before.currentBytes + 4000 || after.liveAllocations != before.liveAllocations + 1 ||
+                after.totalAllocations != before.totalAllocations + 3 || after.peakBytes < before.currentBytes + 4000) {
+                LOG_ERR("Memory tracker counts are wrong after release and growth");
+                return -1;
+            }
+
+            // Pool blocks move from the pool's free space to their category and back
+            DevicePool pool(64 << 10);
+            {
+                ConstBuffer<int> pooled(100, pool, {}, MEM_TEXTURE);
+                if (memory::stats(MEM_TEXTURE).liveAllocations == 0 || memory::currentBytes() != totalBefore + 4000 + (64 << 10)) {
+                    LOG_ERR("Memory tracker should count pooled blocks in their category, not on top of the slab");
+                    return -1;
+                }
+            }
+            LOG_INFO("Device memory:\n" + memory::report());
+            LOG_SUCCESS("Memory tracking test passed");
+        }
+        
+        // Test 12: Range updates and ShadowedBuffer
+        LOG_INFO("=== Test 12: Range updates and ShadowedBuffer ===");
+        {
+            AllPurposeBuffer<int> ranged(10, std::vector<int>(10, 0));
+            std::vector<int> middle = {7, 8, 9};
+            ranged.writeRange(4, std::span<const int>(middle));
+            std::vector<int> part(4);
+            ranged.readRange(3, std::span<int>(part));
+            if (part != std::vector<int>{0, 7, 8, 9}) {
+                LOG_ERR("writeRange/readRange verification failed!");
+                return -1;
+            }
+
+            std::vector<detail::Range> ranges = {{20, 30}, {0, 4}, {4, 8}, {32, 40}, {25, 26}};
+            detail::coalesceRanges(ranges);
+            if (ranges.size() != 3 || ranges[0].begin != 0 || ranges[0].end != 8 || ranges[1].begin != 20 || ranges[1].end != 30) {
+                LOG_ERR("coalesceRanges should merge touching and overlapping ranges");
+                return -1;
+            }
+            detail::coalesceRanges(ranges, 2);
+            if (ranges.size() != 2 || ranges[1].end != 40) {
+                LOG_ERR("coalesceRanges should merge ranges within the gap");
+                return -1;
+            }
+
+            std::vector<int> values(1000);
+            for (int i = 0; i < 1000; i++) values[i] = i;
+            ShadowedBuffer<int> shadowed(1000, std::span<const int>(values));
+            AllPurposeBuffer<int> check(1000);
+            for (int round = 0; round < 2; round++) {
+                // Scattered and overlapping edits, then one flush
+                shadowed.set(10, -1);
+                shadowed.set(11, -2);
+                std::span<int> block = shadowed.edit(500, 20);
+                for (int i = 0; i < 20; i++) block[i] = round * 1000 + i;
+                std::vector<int> tail = {round, round, round};
+                shadowed.writeRange(997, std::span<const int>(tail));
+                shadowed.writeRange(510, std::span<const int>(tail));
+                if (!shadowed.isDirty() || !shadowed.flush()() || shadowed.isDirty()) {
+                    LOG_ERR("ShadowedBuffer should upload its dirty ranges once");
+                    return -1;
+                }
+                gpuQueue().enqueueCopyBuffer(shadowed.getCLBuffer(), check.getCLBuffer(), 0, 0, sizeof(int) * 1000);
+                std::vector<int> readBack;
+                check.readTo(readBack);
+                if (!std::equal(readBack.begin(), readBack.end(), shadowed.data().begin())) {
+                    LOG_ERR("ShadowedBuffer device copy differs from the host copy in round " + std::to_string(round));
+                    return -1;
+                }
+            }
+            if (shadowed.flush()()) {
+                LOG_ERR("ShadowedBuffer flushed without edits");
+                return -1;
+            }
+            LOG_SUCCESS("Range update test passed");
+        }
+        
+        // Test 13: Frames in flight - every frame is returned once, in order
+        LOG_INFO("=== Test 13: Frames in flight ===");
+        {
+            struct CountingTarget : RenderTarget {
+                std::vector<uint64_t> frames;
+                void present(const uint32_t*, int, int, uint64_t frame) override { frames.push_back(frame); }
+            };
+            for (int framesInFlight : {1, 2, 3}) {
+                Renderer renderer(64, 64, 100, framesInFlight);
+                CountingTarget target;
+                const int FRAMES = 6;
+                for (int frame = 0; frame < FRAMES; frame++) {
+                    renderer.startNewFrame();
+                    renderer.clear();
+                    renderer.executeBinningPass();
+                    renderer.executeFinishFrameTileBased();
+                    size_t presented = target.frames.size();
+                    bool returned = renderer.finishFrame(target);
+                    // The first framesInFlight - 1 calls have nothing to return yet
+                    if (returned != (frame >= framesInFlight - 1) || target.frames.size() != presented + returned) {
+                        LOG_ERR("finishFrame returned a frame too early or too late with " + std::to_string(framesInFlight) + " frames in flight");
+                        return -1;
+                    }
+                    if (returned && presented > 0 && renderer.lastFrameNumber() <= target.frames[presented - 1]) {
+                        LOG_ERR("finishFrame returned frame " + std::to_string(renderer.lastFrameNumber()) + " again");
+                        return -1;
+                    }
+                }
+                renderer.finishPendingFrames(target);
+                for (int frame = 0; frame < FRAMES; frame++) {
+                    if (target.frames.size() != FRAMES || target.frames[frame] != (uint64_t)frame) {
+                        LOG_ERR("Every frame should be presented exactly once, in order, with " + std::to_string(framesInFlight) + " frames in flight");
+                        return -1;
+                    }
+                }
+            }
+            LOG_SUCCESS("Frames in flight test passed");
+        }
+        
         LOG_SUCCESS("All buffer tests completed successfully!");
         
-        // Test 7: Demonstrate compile-time flag validation
-        LOG_INFO("=== Test 7: Compile-time flag validation ===");
+        // Test 14: Demonstrate compile-time flag validation
+        LOG_INFO("=== Test 14: Compile-time flag validation ===");
         LOG_INFO("The following would cause compile-time errors if uncommented:");
         LOG_INFO("// ConstBuffer<int> buf(5);");
         LOG_INFO("// buf.writeFrom(data); // ERROR: HOST_WRITE not allowed");
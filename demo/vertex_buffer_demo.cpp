@@ -114,9 +114,13 @@ int main() {
         // Execute binning pass and tile-based rendering
         renderer.executeBinningPass();
         renderer.executeFinishFrameTileBased();
-        Uint32* colorBuffer = renderer.finishFrame();
-        SDL_UpdateTexture(texture, NULL, colorBuffer, screenWidth * sizeof(Uint32));
-        SDL_RenderCopy(sdlRenderer, texture, NULL, NULL);
+        void* pixels;
+        int pitch;
+        SDL_LockTexture(texture, NULL, &pixels, &pitch);
+        bool hasFrame = renderer.finishFrame((uint32_t*)pixels, pitch / sizeof(Uint32));
+        SDL_UnlockTexture(texture);
+        // The first frame only comes back on the next call - until then the texture holds garbage
+        if (hasFrame) SDL_RenderCopy(sdlRenderer, texture, NULL, NULL);
 
         // Add frame counter
         drawText("Frame: " + std::to_string(frameCount), 10, screenHeight - 30, sdlRenderer);
@@ -0,0 +1,21 @@
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include <optional>
+#include "rendering.hpp"
+
+// Tile configuration autotuning for the current device (see TuningMode in rendering.hpp).
+// Results are stored per device, driver and resolution next to the kernel cache
+// (ProgramCache::defaultDirectory()), so only the first run pays for the benchmark.
+
+// Renders a synthetic scene with every candidate tile size and work-group shape
+// and returns the fastest configuration. Takes a few seconds, most of it compiling kernel variants.
+TileConfig autotuneTileConfig(int scr_w, int scr_h, int scr_z);
+
+std::optional<TileConfig> loadTileConfig(int scr_w, int scr_h);
+void storeTileConfig(int scr_w, int scr_h, const TileConfig& config);
+
+// Applies LR_AUTOTUNE and returns the configuration a renderer should use (0 fields for defaults)
+TileConfig resolveTileConfig(int scr_w, int scr_h, int scr_z, TuningMode mode);
+
+#endif // AUTOTUNE_HPP
@@ -2,22 +2,76 @@
 #define BUFFER_HPP
 
 #include "log.hpp"
+#include "memory_tracker.hpp"
 #include <vector>
 #include <stdexcept>
 #include <type_traits>
 #include <algorithm> 
+#include <memory>
 #include <span>
 #include <CL/opencl.hpp>
 
 // Forward declare helper accessors implemented in rendering2.cpp
 cl::Context& gpuContext();
 cl::CommandQueue& gpuQueue();
+// Extra flags for every buffer allocation (CL_MEM_ALLOC_HOST_PTR on CPU devices,
+// so the runtime can share memory with the host instead of copying)
+cl_mem_flags gpuAllocFlags();
 
 // Forward declaration of GPU with the minimal API used in this header
 class GPU; // opaque; full definition elsewhere.
 GPU& getGPU();
 
 namespace lr {
+class DevicePool; // device_pool.hpp
+}
+// Pool shared by the library's long-lived buffers (meshes, textures), see device_pool.hpp
+lr::DevicePool& gpuDevicePool();
+
+namespace lr {
+
+// A block of device memory from a DevicePool. It goes back to the pool when the last copy
+// of owner is gone - buffer (a sub-buffer of one of the pool's slabs) mustn't be used after that.
+struct PoolAllocation {
+    cl::Buffer buffer;
+    std::shared_ptr<const void> owner;
+};
+// Same as pool.allocate(bytes, category), usable where DevicePool is incomplete
+PoolAllocation allocateFromPool(DevicePool& pool, size_t bytes, MemoryCategory category);
+
+namespace detail {
+    // Keeps host memory alive until the command behind event has completed (or failed)
+    inline void releaseOnCompletion(cl::Event& event, std::shared_ptr<const void> memory) {
+        auto* holder = new std::shared_ptr<const void>(std::move(memory));
+        cl_int err = event.setCallback(CL_COMPLETE, [](cl_event, cl_int, void* data) {
+            delete static_cast<std::shared_ptr<const void>*>(data);
+        }, holder);
+        if (err != CL_SUCCESS) {
+            event.wait();
+            delete holder;
+        }
+    }
+
+    // Element range [begin, end)
+    struct Range {
+        size_t begin, end;
+    };
+
+    // Sorts ranges and merges the ones that overlap or are at most mergeGap elements apart
+    inline void coalesceRanges(std::vector<Range>& ranges, size_t mergeGap = 0) {
+        if (ranges.size() < 2) return;
+        std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+        size_t merged = 0;
+        for (size_t i = 1; i < ranges.size(); i++) {
+            if (ranges[i].begin <= ranges[merged].end + mergeGap) {
+                ranges[merged].end = std::max(ranges[merged].end, ranges[i].end);
+            } else {
+                ranges[++merged] = ranges[i];
+            }
+        }
+        ranges.resize(merged + 1);
+    }
+}
 
 // Base class holds the common state.
 template<typename T>
@@ -25,6 +79,8 @@ class BaseBuffer {
 protected:
     size_t m_size;
     cl::Buffer m_buffer;
+    // Handle on m_buffer's memory: its DevicePool block, or its registration with the memory tracker
+    std::shared_ptr<const void> m_allocation;
 
     BaseBuffer(size_t elementCount) : m_size(elementCount) {
         static_assert(std::is_trivially_copyable<T>::value, 
@@ -36,6 +92,9 @@ public:
     size_t size() const { return m_size; }
     // Used when we want to pass it to a kernel. 
     const cl::Buffer& getCLBuffer() const { return m_buffer; }
+    // Hold on to this to keep using getCLBuffer() after the buffer is gone - pooled memory
+    // is otherwise handed to the next allocation (and the memory would no longer be accounted).
+    const std::shared_ptr<const void>& getAllocation() const { return m_allocation; }
 };
 
 // These flags determine what can be done with the buffer.
@@ -115,10 +174,10 @@ template<typename T, BufferFlag... Flags>
 class GeneralBuffer : public BaseBuffer<T> {
 public:
     // Constructor with optional initial data
-    GeneralBuffer(size_t elementCount, const std::vector<T> &data = {})
+    GeneralBuffer(size_t elementCount, const std::vector<T> &data = {}, MemoryCategory category = MEM_BUFFER)
     : BaseBuffer<T>(elementCount) {
         
-        cl_mem_flags clFlags = deduceFlags<Flags...>();
+        cl_mem_flags clFlags = deduceFlags<Flags...>() | gpuAllocFlags();
         // Use initial data if provided:
         const T* hostPtr = nullptr;
         if (!data.empty()) {
@@ -137,19 +196,24 @@ public:
             // OpenCL wants void* anyway.
             const_cast<void*>(static_cast<const void*>(hostPtr))
         );
+        this->m_allocation = memory::track(category, sizeof(T) * elementCount);
         
         LOG_DEBUG("Created GeneralBuffer with " + std::to_string(elementCount) + " elements of size " + std::to_string(sizeof(T)));
     }
 
+    // Constructor without initial data, accounted under category
+    GeneralBuffer(size_t elementCount, MemoryCategory category)
+    : GeneralBuffer(elementCount, std::vector<T>{}, category) {}
+
     // Constructor from span
-    GeneralBuffer(size_t elementCount, const std::span<const T> &data)
+    GeneralBuffer(size_t elementCount, const std::span<const T> &data, MemoryCategory category = MEM_BUFFER)
     : BaseBuffer<T>(elementCount) {
 
         if (data.size() != elementCount) {
             LOG_FATAL("GeneralBuffer: Data size doesn't match element count");
         }
 
-        cl_mem_flags clFlags = deduceFlags<Flags...>();
+        cl_mem_flags clFlags = deduceFlags<Flags...>() | gpuAllocFlags();
         clFlags |= CL_MEM_COPY_HOST_PTR;
         
         // Create the OpenCL buffer.
@@ -160,10 +224,37 @@ public:
             // OpenCL wants void* anyway.
             const_cast<void*>(static_cast<const void*>(data.data()))
         );
+        this->m_allocation = memory::track(category, sizeof(T) * elementCount);
         
         LOG_DEBUG("Created GeneralBuffer from span with " + std::to_string(elementCount) + " elements of size " + std::to_string(sizeof(T)));
     }
 
+    // Constructor taking the memory from a pool (no driver call once the pool has a free block
+    // of the size). Pool blocks are sub-buffers, which can't copy a host pointer on creation,
+    // so initial data is written by a blocking write.
+    GeneralBuffer(size_t elementCount, DevicePool& pool, const std::span<const T> &data = {}, MemoryCategory category = MEM_BUFFER)
+    : BaseBuffer<T>(elementCount) {
+
+        if (!data.empty() && data.size() != elementCount) {
+            LOG_FATAL("GeneralBuffer: Data size doesn't match element count");
+        }
+
+        PoolAllocation allocation = allocateFromPool(pool, sizeof(T) * elementCount, category);
+        this->m_buffer = allocation.buffer;
+        this->m_allocation = std::move(allocation.owner);
+
+        if (!data.empty()) {
+            cl_int err = gpuQueue().enqueueWriteBuffer(
+                this->m_buffer, CL_TRUE, 0, sizeof(T) * elementCount, data.data()
+            );
+            if (err != CL_SUCCESS) {
+                LOG_FATAL("GeneralBuffer: initial write to pooled buffer failed with error: " + std::to_string(err));
+            }
+        }
+
+        LOG_DEBUG("Created pooled GeneralBuffer with " + std::to_string(elementCount) + " elements of size " + std::to_string(sizeof(T)));
+    }
+
     // Write methods (require HOST_WRITE flag)
     void writeFrom(const std::vector<T> &data) {
         static_assert(has_flag<HOST_WRITE, Flags...>(), "Buffer must have HOST_WRITE flag to use writeFrom");
@@ -201,6 +292,53 @@ public:
         LOG_DEBUG("Wrote " + std::to_string(data.size()) + " elements to buffer from span");
     }
 
+    // Writes data to elements [offset, offset + data.size()) and leaves the rest untouched
+    void writeRange(size_t offset, const std::span<const T> data) {
+        static_assert(has_flag<HOST_WRITE, Flags...>(), "Buffer must have HOST_WRITE flag to use writeRange");
+
+        if (offset > this->m_size || data.size() > this->m_size - offset) {
+            LOG_FATAL("GeneralBuffer::writeRange: Range is outside the buffer");
+        }
+        if (data.empty()) return;
+
+        cl_int err = gpuQueue().enqueueWriteBuffer(
+            this->m_buffer, CL_TRUE, sizeof(T) * offset, sizeof(T) * data.size(), data.data()
+        );
+
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("GeneralBuffer::writeRange failed with error: " + std::to_string(err));
+        }
+    }
+
+    // Asynchronous writes return as soon as the write is queued. The returned event completes
+    // when the data is on the device; waitFor lists events the write has to wait for.
+    // This overload reads data until then, so the caller keeps it alive and unchanged.
+    cl::Event writeFromAsync(const std::span<const T> data, const std::vector<cl::Event>* waitFor = nullptr) {
+        static_assert(has_flag<HOST_WRITE, Flags...>(), "Buffer must have HOST_WRITE flag to use writeFromAsync");
+
+        if (data.size() != this->m_size) {
+            LOG_FATAL("GeneralBuffer::writeFromAsync: Data size doesn't match buffer size");
+        }
+
+        cl::Event event;
+        cl_int err = gpuQueue().enqueueWriteBuffer(
+            this->m_buffer, CL_FALSE, 0, sizeof(T) * this->m_size, data.data(), waitFor, &event
+        );
+
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("GeneralBuffer::writeFromAsync failed with error: " + std::to_string(err));
+        }
+        return event;
+    }
+
+    // Takes the data over and frees it once the write is done - nothing for the caller to keep alive
+    cl::Event writeFromAsync(std::vector<T> &&data, const std::vector<cl::Event>* waitFor = nullptr) {
+        auto owned = std::make_shared<const std::vector<T>>(std::move(data));
+        cl::Event event = writeFromAsync(std::span<const T>(*owned), waitFor);
+        detail::releaseOnCompletion(event, owned);
+        return event;
+    }
+
     // Read methods (require HOST_READ flag)
     void readTo(std::vector<T> &data) {
         static_assert(has_flag<HOST_READ, Flags...>(), "Buffer must have HOST_READ flag to use readTo");
@@ -234,6 +372,349 @@ public:
         
         LOG_DEBUG("Read " + std::to_string(data.size()) + " elements from buffer to span");
     }
+
+    // Reads elements [offset, offset + data.size()) into data
+    void readRange(size_t offset, std::span<T> data) {
+        static_assert(has_flag<HOST_READ, Flags...>(), "Buffer must have HOST_READ flag to use readRange");
+
+        if (offset > this->m_size || data.size() > this->m_size - offset) {
+            LOG_FATAL("GeneralBuffer::readRange: Range is outside the buffer");
+        }
+        if (data.empty()) return;
+
+        cl_int err = gpuQueue().enqueueReadBuffer(
+            this->m_buffer, CL_TRUE, sizeof(T) * offset, sizeof(T) * data.size(), data.data()
+        );
+
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("GeneralBuffer::readRange failed with error: " + std::to_string(err));
+        }
+    }
+
+    // Asynchronous read - data is filled in once the returned event completes,
+    // so it has to stay alive and untouched until then
+    cl::Event readToAsync(std::span<T> data, const std::vector<cl::Event>* waitFor = nullptr) {
+        static_assert(has_flag<HOST_READ, Flags...>(), "Buffer must have HOST_READ flag to use readToAsync");
+
+        if (data.size() != this->m_size) {
+            LOG_FATAL("GeneralBuffer::readToAsync: Data size doesn't match buffer size");
+        }
+
+        cl::Event event;
+        cl_int err = gpuQueue().enqueueReadBuffer(
+            this->m_buffer, CL_FALSE, 0, sizeof(T) * this->m_size, data.data(), waitFor, &event
+        );
+
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("GeneralBuffer::readToAsync failed with error: " + std::to_string(err));
+        }
+        return event;
+    }
+};
+
+// Device buffer meant to be kept across frames. Its capacity only grows (by doubling),
+// so once it has reached the working-set size no further device allocations happen.
+// size() is the number of elements in use - only that range is uploaded or preserved.
+template<typename T>
+class DynamicBuffer : public BaseBuffer<T> {
+private:
+    size_t m_capacity;
+    MemoryCategory m_category;
+
+public:
+    explicit DynamicBuffer(size_t initialCapacity = 64, MemoryCategory category = MEM_BUFFER)
+    : BaseBuffer<T>(0), m_capacity(std::max<size_t>(initialCapacity, 1)), m_category(category) {
+        this->m_buffer = cl::Buffer(gpuContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), sizeof(T) * m_capacity);
+        this->m_allocation = memory::track(m_category, sizeof(T) * m_capacity);
+        LOG_DEBUG("Created DynamicBuffer with capacity " + std::to_string(m_capacity) + " elements of size " + std::to_string(sizeof(T)));
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+    // Makes room for at least elementCount elements, keeping the elements in use.
+    // Returns true if the device buffer was reallocated (kernel arguments must be re-bound).
+    bool reserve(size_t elementCount) {
+        if (elementCount <= m_capacity) return false;
+
+        size_t newCapacity = std::max(elementCount, m_capacity * 2);
+        cl::Buffer newBuffer(gpuContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), sizeof(T) * newCapacity);
+        if (this->m_size > 0) {
+            cl_int err = gpuQueue().enqueueCopyBuffer(this->m_buffer, newBuffer, 0, 0, sizeof(T) * this->m_size);
+            if (err != CL_SUCCESS) {
+                LOG_FATAL("DynamicBuffer::reserve copy failed with error: " + std::to_string(err));
+            }
+        }
+        // The old buffer is released here; OpenCL keeps it alive until the copy is done
+        this->m_buffer = newBuffer;
+        this->m_allocation = memory::track(m_category, sizeof(T) * newCapacity);
+        m_capacity = newCapacity;
+
+        LOG_DEBUG("DynamicBuffer grown to " + std::to_string(m_capacity) + " elements");
+        return true;
+    }
+
+    // Changes the number of elements in use. Elements below the old size are kept.
+    bool resize(size_t elementCount) {
+        bool reallocated = reserve(elementCount);
+        this->m_size = elementCount;
+        return reallocated;
+    }
+
+    // Drops all elements without releasing the device memory
+    void clear() { this->m_size = 0; }
+
+    // Replaces the contents with data. With blocking == false the caller has to keep
+    // data alive until the queue has executed the write (signalled by event, if given).
+    bool writeFrom(const std::span<const T> data, bool blocking = true, cl::Event* event = nullptr) {
+        clear();
+        bool reallocated = resize(data.size());
+        if (data.empty()) return reallocated;
+
+        cl_int err = gpuQueue().enqueueWriteBuffer(
+            this->m_buffer, blocking ? CL_TRUE : CL_FALSE, 0, sizeof(T) * data.size(), data.data(), nullptr, event
+        );
+
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("DynamicBuffer::writeFrom failed with error: " + std::to_string(err));
+        }
+        return reallocated;
+    }
+
+    void readTo(std::vector<T> &data) {
+        data.resize(this->m_size);
+        if (data.empty()) return;
+
+        cl_int err = gpuQueue().enqueueReadBuffer(
+            this->m_buffer, CL_TRUE, 0, sizeof(T) * this->m_size, data.data()
+        );
+
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("DynamicBuffer::readTo failed with error: " + std::to_string(err));
+        }
+    }
+};
+
+// Elements [offset, offset + count) of a device buffer, e.g. one StreamingBuffer allocation
+template<typename T>
+struct BufferRange {
+    cl::Buffer buffer;
+    size_t offset = 0;
+    size_t count = 0;
+    std::shared_ptr<const void> owner;  // Keeps pooled memory alive, see BaseBuffer::getAllocation()
+};
+
+// Upload ring for data that's rebuilt every frame: one device buffer split into a segment per
+// frame in flight. allocate() copies into the current segment's host staging area and flush()
+// uploads everything allocated since the last flush in one write - flush before queueing the
+// commands that read the ranges. beginFrame() moves to the next segment and waits for the write
+// that last used it (its fence), so the staging memory of frames in flight is never overwritten.
+// A frame that outgrows its segment moves the ring to a bigger buffer; ranges handed out before
+// keep referring to the old one.
+template<typename T>
+class StreamingBuffer : public BaseBuffer<T> {
+private:
+    struct Segment {
+        std::vector<T> staging;
+        size_t used = 0;
+        size_t flushed = 0;
+        cl::Event fence;  // Last write from staging
+    };
+    size_t m_frameCapacity;
+    std::vector<Segment> m_segments;
+    size_t m_current = 0;
+
+    void createBuffer() {
+        this->m_size = m_frameCapacity * m_segments.size();
+        this->m_buffer = cl::Buffer(gpuContext(), CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY | gpuAllocFlags(), sizeof(T) * this->m_size);
+        this->m_allocation = memory::track(MEM_FRAME, sizeof(T) * this->m_size);
+        for (Segment& segment : m_segments) {
+            segment.staging.resize(m_frameCapacity);
+        }
+    }
+
+    void grow(size_t elementCount) {
+        flush();
+        // Writes still in flight read the old staging areas - they're freed once those are done
+        for (Segment& segment : m_segments) {
+            if (segment.fence()) {
+                detail::releaseOnCompletion(segment.fence, std::make_shared<const std::vector<T>>(std::move(segment.staging)));
+            }
+            segment = Segment();
+        }
+        m_frameCapacity = std::max(elementCount, m_frameCapacity * 2);
+        createBuffer();
+        LOG_DEBUG("StreamingBuffer grown to " + std::to_string(m_frameCapacity) + " elements per frame");
+    }
+
+public:
+    StreamingBuffer(size_t frameCapacity, int framesInFlight = 2)
+    : BaseBuffer<T>(0), m_frameCapacity(std::max<size_t>(frameCapacity, 1)), m_segments(std::max(framesInFlight, 1)) {
+        createBuffer();
+        LOG_DEBUG("Created StreamingBuffer with " + std::to_string(m_segments.size()) + " segments of " + std::to_string(m_frameCapacity) + " elements");
+    }
+
+    ~StreamingBuffer() {
+        // The staging areas are read until the last writes are done
+        for (Segment& segment : m_segments) {
+            if (segment.fence()) segment.fence.wait();
+        }
+    }
+
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+
+    size_t frameCapacity() const { return m_frameCapacity; }
+    size_t frameSize() const { return m_segments[m_current].used; }  // Elements allocated this frame
+
+    void beginFrame() {
+        m_current = (m_current + 1) % m_segments.size();
+        Segment& segment = m_segments[m_current];
+        if (segment.fence()) {
+            segment.fence.wait();
+            segment.fence = cl::Event();
+        }
+        segment.used = 0;
+        segment.flushed = 0;
+    }
+
+    BufferRange<T> allocate(const std::span<const T> data) {
+        if (m_segments[m_current].used + data.size() > m_frameCapacity) {
+            grow(m_segments[m_current].used + data.size());
+        }
+        Segment& segment = m_segments[m_current];
+        size_t offset = segment.used;
+        std::copy(data.begin(), data.end(), segment.staging.begin() + offset);
+        segment.used += data.size();
+        return {this->m_buffer, m_current * m_frameCapacity + offset, data.size()};
+    }
+
+    // Returns the event of the write, or an empty event if there was nothing to upload
+    cl::Event flush() {
+        Segment& segment = m_segments[m_current];
+        if (segment.used == segment.flushed) return cl::Event();
+
+        size_t first = m_current * m_frameCapacity + segment.flushed;
+        cl_int err = gpuQueue().enqueueWriteBuffer(
+            this->m_buffer, CL_FALSE, sizeof(T) * first, sizeof(T) * (segment.used - segment.flushed),
+            segment.staging.data() + segment.flushed, nullptr, &segment.fence
+        );
+
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("StreamingBuffer::flush failed with error: " + std::to_string(err));
+        }
+        segment.flushed = segment.used;
+        return segment.fence;
+    }
+};
+
+// Device buffer with a host copy that is edited in place. Edits only mark their elements dirty;
+// flush() uploads the dirty ranges, merged into as few writes as possible, so changing a few
+// elements of a big buffer sends just those. The device copy is only read by kernels - the host
+// copy is the one that's up to date.
+// Writes read straight from the host copy: the first edit after a flush waits until the
+// uploads are done (usually long since, as the next edit comes a frame later).
+template<typename T>
+class ShadowedBuffer : public BaseBuffer<T> {
+private:
+    std::vector<T> m_shadow;
+    std::vector<detail::Range> m_dirty;
+    size_t m_mergeGap = 0;
+    cl::Event m_fence;  // Last upload from m_shadow
+
+    void waitForUpload() {
+        if (m_fence()) {
+            m_fence.wait();
+            m_fence = cl::Event();
+        }
+    }
+
+    void markDirty(size_t begin, size_t end) {
+        // Sequential edits extend the last range instead of adding one
+        if (!m_dirty.empty() && begin <= m_dirty.back().end && end >= m_dirty.back().begin) {
+            m_dirty.back().begin = std::min(m_dirty.back().begin, begin);
+            m_dirty.back().end = std::max(m_dirty.back().end, end);
+        } else {
+            m_dirty.push_back({begin, end});
+        }
+    }
+
+public:
+    ShadowedBuffer(size_t elementCount, const std::span<const T> data = {}, MemoryCategory category = MEM_BUFFER)
+    : BaseBuffer<T>(elementCount), m_shadow(elementCount) {
+        if (!data.empty()) {
+            if (data.size() != elementCount) {
+                LOG_FATAL("ShadowedBuffer: Data size doesn't match element count");
+            }
+            std::copy(data.begin(), data.end(), m_shadow.begin());
+        }
+        cl_mem_flags clFlags = CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY | gpuAllocFlags();
+        if (!m_shadow.empty()) clFlags |= CL_MEM_COPY_HOST_PTR;
+        this->m_buffer = cl::Buffer(
+            gpuContext(),
+            clFlags,
+            sizeof(T) * std::max<size_t>(elementCount, 1),
+            m_shadow.empty() ? nullptr : static_cast<void*>(m_shadow.data())
+        );
+        this->m_allocation = memory::track(category, sizeof(T) * elementCount);
+        LOG_DEBUG("Created ShadowedBuffer with " + std::to_string(elementCount) + " elements of size " + std::to_string(sizeof(T)));
+    }
+
+    ~ShadowedBuffer() {
+        waitForUpload();
+    }
+
+    ShadowedBuffer(const ShadowedBuffer&) = delete;
+    ShadowedBuffer& operator=(const ShadowedBuffer&) = delete;
+
+    // The host copy, current as of the last edit
+    std::span<const T> data() const { return m_shadow; }
+    const T& operator[](size_t index) const { return m_shadow[index]; }
+
+    // Elements [offset, offset + count) of the host copy to modify - all of them are uploaded
+    // by the next flush. The span is only for changes made before that flush.
+    std::span<T> edit(size_t offset, size_t count) {
+        if (offset > this->m_size || count > this->m_size - offset) {
+            LOG_FATAL("ShadowedBuffer::edit: Range is outside the buffer");
+        }
+        waitForUpload();
+        if (count > 0) markDirty(offset, offset + count);
+        return std::span<T>(m_shadow).subspan(offset, count);
+    }
+
+    void set(size_t index, const T& value) {
+        edit(index, 1)[0] = value;
+    }
+
+    void writeRange(size_t offset, const std::span<const T> data) {
+        std::span<T> destination = edit(offset, data.size());
+        std::copy(data.begin(), data.end(), destination.begin());
+    }
+
+    // Dirty ranges at most this many elements apart are uploaded as one write, re-sending the
+    // clean elements between them - fewer commands for scattered edits. 0 (the default) only
+    // merges ranges that touch.
+    void setMergeGap(size_t elements) { m_mergeGap = elements; }
+
+    bool isDirty() const { return !m_dirty.empty(); }
+
+    // Queues the uploads of the dirty ranges. Returns the event of the last one (the queue is
+    // in order, so it completes after all of them), or an empty event if nothing was dirty.
+    cl::Event flush() {
+        if (m_dirty.empty()) return cl::Event();
+        detail::coalesceRanges(m_dirty, m_mergeGap);
+        for (const detail::Range& range : m_dirty) {
+            cl_int err = gpuQueue().enqueueWriteBuffer(
+                this->m_buffer, CL_FALSE, sizeof(T) * range.begin, sizeof(T) * (range.end - range.begin),
+                m_shadow.data() + range.begin, nullptr, &m_fence
+            );
+            if (err != CL_SUCCESS) {
+                LOG_FATAL("ShadowedBuffer::flush failed with error: " + std::to_string(err));
+            }
+        }
+        LOG_DEBUG("ShadowedBuffer flushed " + std::to_string(m_dirty.size()) + " ranges");
+        m_dirty.clear();
+        return m_fence;
+    }
 };
 
 } // namespace lr
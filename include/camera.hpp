@@ -13,6 +13,9 @@ private:
     // Camera orientation (in radians)
     float yaw, pitch, roll;
     
+    // Rotation part of transformVertex
+    vec rotateToCamera(const vec& v) const;
+    
 public:
     // Constructor - default camera at origin looking down -Z axis
     Camera(float x = 0.0f, float y = 0.0f, float z = 0.0f, 
@@ -60,6 +63,10 @@ public:
     // Transform a vertex from world space to camera space
     vec transformVertex(const vec& worldVertex) const;
     
+    // Same transform as transformVertex as a 3x4 matrix (rotation | translation), row by row.
+    // Used to transform vertices on the GPU.
+    void getViewMatrix(float rows[3][4]) const;
+    
     // Get view direction vector
     vec getForwardVector() const;
     vec getRightVector() const;
@@ -0,0 +1,82 @@
+#ifndef DEVICE_POOL_HPP
+#define DEVICE_POOL_HPP
+
+#include "buffer.hpp"
+#include <memory>
+
+namespace lr {
+
+// Sub-allocator for device buffers. Reserves large slabs and carves power-of-two blocks out of
+// them with createSubBuffer. A freed block goes on the free list of its size class and is handed
+// out again as it is, so once the pool has warmed up an allocation is a pop from a list - O(1)
+// and no driver call. Requests larger than the biggest class get a buffer of their own.
+//
+// A block is freed when the last owner handle (PoolAllocation::owner, BaseBuffer::getAllocation())
+// goes away. Anything that keeps using a block's cl::Buffer past the lifetime of its buffer object
+// has to hold the owner too - the renderer does for the meshes, textures and vertex buffers it
+// caches. Commands already queued are fine: the next user's commands run after them on the
+// in-order queue.
+class DevicePool {
+public:
+    static constexpr size_t MIN_BLOCK = 256;  // Bytes of the smallest size class
+
+    struct Stats {
+        size_t slabCount = 0;
+        size_t slabBytes = 0;       // Reserved in slabs
+        size_t blocksInUse = 0;
+        size_t bytesInUse = 0;      // In blocks handed out, with the rounding up to the size class
+        size_t dedicatedBytes = 0;  // In buffers too big for a size class
+    };
+
+    // slabBytes is clamped to the device's maximum allocation size
+    explicit DevicePool(size_t slabBytes = 64 << 20);
+    DevicePool(const DevicePool&) = delete;
+    DevicePool& operator=(const DevicePool&) = delete;
+
+    // The block counts as device memory of category in the memory tracker; slab space
+    // that isn't handed out is accounted as MEM_POOL
+    PoolAllocation allocate(size_t bytes, MemoryCategory category = MEM_BUFFER);
+    Stats stats() const;
+
+private:
+    struct State;
+    std::shared_ptr<State> state;  // Shared with the blocks' owners, which can outlive the pool
+};
+
+// Linear allocator for device-only data that lives for one frame: an allocation bumps an offset
+// into one buffer and reset() frees everything at once. Reusing the memory after reset() is safe
+// because the in-order queue finishes the commands of the previous frame before anything queued
+// later - don't use it for memory the host reads or writes asynchronously.
+// A frame that doesn't fit moves the arena to a bigger buffer; ranges handed out before keep the old one.
+class FrameArena {
+private:
+    cl::Buffer m_buffer;
+    std::shared_ptr<const void> m_allocation;  // Memory tracker registration of m_buffer
+    size_t m_capacity;
+    size_t m_used = 0;
+
+    void grow(size_t bytes);
+
+public:
+    explicit FrameArena(size_t bytes);
+
+    template<typename T>
+    BufferRange<T> allocate(size_t count) {
+        // Element offsets need the range to start at a multiple of the element size
+        size_t offset = (m_used + sizeof(T) - 1) / sizeof(T) * sizeof(T);
+        if (offset + sizeof(T) * count > m_capacity) {
+            grow(sizeof(T) * count);
+            offset = 0;
+        }
+        m_used = offset + sizeof(T) * count;
+        return {m_buffer, offset / sizeof(T), count};
+    }
+
+    void reset() { m_used = 0; }
+    size_t used() const { return m_used; }
+    size_t capacity() const { return m_capacity; }
+};
+
+} // namespace lr
+
+#endif // DEVICE_POOL_HPP
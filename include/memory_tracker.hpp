@@ -0,0 +1,63 @@
+#ifndef MEMORY_TRACKER_HPP
+#define MEMORY_TRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace lr {
+    // What a device allocation is used for
+    enum MemoryCategory {
+        MEM_BUFFER,         // Buffers created without a category
+        MEM_MESH,           // Mesh vertices and triangles
+        MEM_TEXTURE,
+        MEM_FRAME,          // Rebuilt every frame: streamed vertices, instances, the renderer's vertex and texture pools
+        MEM_BINNING,        // Binner's triangle, setup and tile buffers
+        MEM_RENDER_TARGET,  // Depth, color and per-target data of the renderer's frames in flight
+        MEM_POOL,           // DevicePool slab space not handed out
+        MEM_CATEGORY_COUNT
+    };
+
+    // Accounting of device memory per category. Every buffer the library creates registers here,
+    // so the numbers cover all device memory except what the OpenCL runtime allocates internally.
+    // A total above the warning threshold (a fraction of CL_DEVICE_GLOBAL_MEM_SIZE) is logged once
+    // each time it's crossed.
+    namespace memory {
+        struct CategoryStats {
+            size_t currentBytes = 0;
+            size_t peakBytes = 0;
+            size_t liveAllocations = 0;
+            uint64_t totalAllocations = 0;  // Ever made - growing every frame means buffers are recreated every frame
+        };
+
+        const char* categoryName(MemoryCategory category);
+
+        // Registers bytes under category until the last copy of the returned handle is gone
+        std::shared_ptr<const void> track(MemoryCategory category, size_t bytes);
+
+        void allocated(MemoryCategory category, size_t bytes);
+        void released(MemoryCategory category, size_t bytes);
+        // Part of an allocation of parent handed out as an allocation of category: the bytes move
+        // from parent to category without changing the total (DevicePool blocks)
+        void suballocated(MemoryCategory parent, MemoryCategory category, size_t bytes);
+        void subreleased(MemoryCategory parent, MemoryCategory category, size_t bytes);
+
+        CategoryStats stats(MemoryCategory category);
+        size_t currentBytes();
+        size_t peakBytes();
+        // Peaks start again from the current values, e.g. between benchmark runs
+        void resetPeaks();
+
+        // Set by initGPU from CL_DEVICE_GLOBAL_MEM_SIZE
+        void setDeviceMemory(size_t bytes);
+        size_t deviceMemory();
+        // Fraction of the device memory, 0.9 by default (LR_MEMORY_WARN overrides it)
+        void setWarningThreshold(double fraction);
+
+        // One line per category with current and peak bytes and the allocation counts
+        std::string report();
+    }
+} // namespace lr
+
+#endif // MEMORY_TRACKER_HPP
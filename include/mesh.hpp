@@ -0,0 +1,53 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <vector>
+#include <optional>
+#include <span>
+#include "buffer.hpp"
+#include "texture.hpp"
+#include "util.hpp"
+
+// Triangle of a mesh as it's stored on the GPU. Same layout as TriangleData in common.cl,
+// but vertex indices are relative to the mesh and tex_offset is 0 (textured) or -1 (solid color).
+// The renderer rebases both onto its pools when the mesh is submitted.
+#pragma pack(push, 1)
+struct MeshTriangle {
+    int v0_idx, v1_idx, v2_idx;
+    float tex_coords[6];
+    int tex_offset;
+    int tex_width, tex_height;
+    int color;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(MeshTriangle) == 52, "MeshTriangle must be exactly 52 bytes to match OpenCL TriangleData");
+
+// Static geometry that is uploaded to the GPU once.
+// Vertices are stored in world space - the renderer applies the camera transform on the GPU
+// every frame, so drawing a mesh needs no CPU work per vertex and no host-to-device copies.
+class Mesh {
+private:
+    size_t vertexCount, triangleCount;
+    lr::ConstBuffer<MeshTriangle> triangleBuffer;  // Built first - it validates the input
+    lr::ConstBuffer<vec> vertexBuffer;
+    std::optional<Texture> texture;
+
+    static std::vector<MeshTriangle> buildTriangles(size_t vertexCount, std::span<const int> indices, std::span<const int> colors,
+                                                    std::span<const TexCoord> texCoords, const std::optional<Texture>& texture);
+
+public:
+    // indices: 3 per triangle, colors: 1 per triangle, texCoords: 1 per vertex (only used with a texture)
+    Mesh(std::span<const vec> vertices, std::span<const int> indices, std::span<const int> colors,
+         std::span<const TexCoord> texCoords = {}, std::optional<Texture> texture = std::nullopt);
+
+    size_t getVertexCount() const { return vertexCount; }
+    size_t getTriangleCount() const { return triangleCount; }
+    const std::optional<Texture>& getTexture() const { return texture; }
+
+    // Used by the renderer to pass the mesh to kernels
+    const lr::ConstBuffer<vec>& getVertexBuffer() const { return vertexBuffer; }
+    const lr::ConstBuffer<MeshTriangle>& getTriangleBuffer() const { return triangleBuffer; }
+};
+
+#endif // MESH_HPP
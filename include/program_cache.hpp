@@ -0,0 +1,44 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <CL/opencl.hpp>
+
+// Builds OpenCL programs for one device and keeps the compiled binaries on disk,
+// so later runs load them instead of invoking the compiler.
+// Entries are keyed by device name, driver version, build options and the source (or IL). Files are
+// named after a hash of the key and hold the full key, so an entry is only used for its own key.
+// A binary the driver rejects is rebuilt from source and replaced.
+class ProgramCache {
+private:
+    cl::Context context;
+    cl::Device device;
+    std::string directory;  // Empty when caching is disabled
+
+    std::string cacheKey(const std::string& content, const std::string& options) const;
+    std::string entryPath(const std::string& key) const;
+    bool loadBinary(const std::string& path, const std::string& key, const std::string& options, cl::Program& program) const;
+    void storeBinary(const std::string& path, const std::string& key, const cl::Program& program) const;
+
+public:
+    // directory: where binaries are kept, an empty string disables the cache
+    ProgramCache(const cl::Context& context, const cl::Device& device, std::string directory = defaultDirectory());
+
+    // Returns a built program, from the cache if possible. Fails with LOG_FATAL if the source doesn't compile.
+    cl::Program build(const std::string& source, const std::string& options);
+
+    // Same for an intermediate language module (SPIR-V). Returns nothing if the device can't consume it,
+    // so the caller can fall back to source.
+    std::optional<cl::Program> buildIL(const std::vector<char>& il, const std::string& options);
+
+    // LR_KERNEL_CACHE_DIR if set ("" disables), otherwise $XDG_CACHE_HOME/lr_kernels or ~/.cache/lr_kernels
+    static std::string defaultDirectory();
+
+    // Name for a file that's written next to path and then renamed over it.
+    // Unique across processes and threads, so concurrent writers never share one.
+    static std::string temporaryPath(const std::string& path);
+};
+
+#endif // PROGRAM_CACHE_HPP
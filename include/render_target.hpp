@@ -0,0 +1,54 @@
+#ifndef RENDER_TARGET_HPP
+#define RENDER_TARGET_HPP
+
+#include <cstdint>
+#include <string>
+
+// Headless output for frames returned by Renderer::finishFrame - no window or SDL needed.
+// Frame pixels are 0x00RRGGBB (the format of fromRgb), rows top to bottom, no padding.
+
+enum ImageFormat {
+    IMAGE_PPM,  // Binary PPM (P6) - fastest to write
+    IMAGE_PNG,  // Uncompressed PNG - larger, but opens everywhere
+};
+
+// Writes the pixels as an image file. Returns false if the file can't be written.
+bool writeImage(const std::string& path, const uint32_t* pixels, int width, int height, ImageFormat format);
+// Format picked from the extension: ".png" is PNG, anything else PPM
+bool writeImage(const std::string& path, const uint32_t* pixels, int width, int height);
+
+// Receives finished frames, see Renderer::finishFrame(RenderTarget&)
+class RenderTarget {
+public:
+    virtual ~RenderTarget() = default;
+    // frame is the renderer's frame number (Renderer::lastFrameNumber()), which counts every frame
+    // the renderer returned - a target that gets only some of them sees gaps
+    virtual void present(const uint32_t* pixels, int width, int height, uint64_t frame) = 0;
+};
+
+// Copies every frame into caller-owned memory, which must hold height rows of pitch pixels
+class MemoryRenderTarget : public RenderTarget {
+private:
+    uint32_t* destination;
+    int pitch;
+public:
+    MemoryRenderTarget(uint32_t* destination, int pitch);
+    void present(const uint32_t* pixels, int width, int height, uint64_t frame) override;
+};
+
+// Writes every frame to its own file. The path is a pattern with at most one %d or %0Nd for the
+// renderer's frame number, e.g. "out/frame_%05d.png" (%% is a literal %); a path without one is overwritten
+// with each frame. Any other conversion is an error.
+class ImageFileTarget : public RenderTarget {
+private:
+    std::string prefix, suffix;  // Around the frame number, with %% already unescaped
+    bool numbered = false;
+    int digits = 0;              // Minimum digits of the frame number, zero padded
+    ImageFormat format;
+public:
+    explicit ImageFileTarget(const std::string& pattern);  // Format from the extension
+    ImageFileTarget(const std::string& pattern, ImageFormat format);
+    void present(const uint32_t* pixels, int width, int height, uint64_t frame) override;
+};
+
+#endif // RENDER_TARGET_HPP
@@ -3,59 +3,198 @@
 #include <iostream>
 #include <optional>
 #include <string>
+#include <span>
+#include <cstdint>
 #include "../include/util.hpp"
 #include "../include/buffer.hpp"
 #include "../include/camera.hpp"
 #include <CL/opencl.hpp>
-#include <SDL2/SDL.h>
 
 // Forward declarations
 class Texture;
 struct TexCoord;
+class Mesh;
+class RenderTarget;
 
 class _GPU;
 class Renderer; // Forward-declaration for friendship
 
+// How initGPU picks the OpenCL device. Only OpenCL 2.x/3.x platforms are considered.
+enum DevicePreference {
+    DEVICE_PREFER_GPU,          // First GPU, any other device (e.g. a CPU runtime like POCL) if there's none (default)
+    DEVICE_GPU_ONLY,            // First GPU, fail if there's none
+    DEVICE_CPU_ONLY,            // First CPU device
+    DEVICE_MOST_COMPUTE_UNITS,  // Device with the most compute units on any platform
+    DEVICE_BY_INDEX,            // Device deviceIndex of platform platformIndex (indices among the 2.x/3.x platforms)
+};
+
+struct DeviceSelection {
+    DevicePreference preference = DEVICE_PREFER_GPU;
+    int platformIndex = 0;
+    int deviceIndex = 0;
+    bool profiling = false;  // Create the queue with CL_QUEUE_PROFILING_ENABLE (see Renderer::getFrameTimings)
+    
+    // Reads the LR_DEVICE environment variable:
+    // "gpu", "prefer-gpu", "cpu", "most-cu" or "<platform>:<device>" (e.g. "0:1").
+    // Unset or unknown values give the default selection.
+    // LR_PROFILE=1 turns on profiling.
+    static DeviceSelection fromEnvironment();
+};
+
 class GPU{
     friend class Renderer;
     private:
         _GPU* pimpl;
     public:
-        GPU();
+        GPU(const DeviceSelection& selection);
         ~GPU();
         bool isInitialized();
+        bool isCPU();  // The renderer uses CPU-friendly defaults on CPU devices
+        bool isProfiling();  // The queue records device timestamps for every command
+        bool hasUnifiedMemory();  // CPU device or integrated GPU - host-visible buffers cost no copy
         cl::Device& getDevice();
         cl::Platform& getPlatform();
         cl::CommandQueue& getQueue();
         cl::Context& getContext();
 };
 
-void initGPU();
+void initGPU();  // Device picked by DeviceSelection::fromEnvironment()
+void initGPU(const DeviceSelection& selection);
 GPU& getGPU();
 void deleteGPU();
 
 class _Renderer;
 
+// How the binning pass stores the triangle list of every screen tile
+enum BinningMode {
+    BINNING_FIXED_SLOTS,  // Fixed number of slots per tile, triangles past the limit are dropped
+    BINNING_PREFIX_SUM,   // Count, prefix sum and scatter into one compact list - no per-tile limit, nothing dropped (default)
+};
+
+// Screen tile size and work-group shape of the tile rendering kernel.
+// 0 means "pick the default for the device". The tile size must be a power of two from 4 to 256
+// and the local size must divide it.
+struct TileConfig {
+    int tileSize = 0;
+    int localX = 0, localY = 0;
+};
+
+// Where the renderer gets its TileConfig from. The LR_AUTOTUNE environment variable
+// ("off", "cached", "auto" or "force") overrides the mode passed to the constructor.
+enum TuningMode {
+    TUNING_OFF,     // Built-in defaults
+    TUNING_CACHED,  // Result of an earlier autotuning run for this device and resolution, defaults if there's none (default)
+    TUNING_AUTO,    // Like TUNING_CACHED, but runs the autotuner (and stores its result) if there's no result yet
+    TUNING_FORCE,   // Always run the autotuner
+};
+
+// How finishFrame gets the color buffer to the host. The LR_READBACK environment variable
+// ("auto", "copy" or "mapped") overrides the mode the renderer starts with; setReadbackMode
+// always uses the mode it's given.
+enum ReadbackMode {
+    READBACK_AUTO,    // Mapped on devices with host-unified memory (CPUs, integrated GPUs), copied otherwise (default)
+    READBACK_COPY,    // Read into a host copy of the color buffer
+    READBACK_MAPPED,  // Color buffers in host-visible memory (CL_MEM_ALLOC_HOST_PTR), mapped instead of read
+};
+
+// Device time of one frame per stage in nanoseconds, summed over the stage's commands.
+// Only measured on a profiling queue (DeviceSelection::profiling or LR_PROFILE=1), zero otherwise.
+struct FrameTimings {
+    uint64_t clear = 0;      // Clearing depth and color
+    uint64_t upload = 0;     // Host-to-device transfers and copies into the vertex/texture pools
+    uint64_t transform = 0;  // Mesh vertex transform and triangle expansion
+    uint64_t binning = 0;    // Triangle setup and binning passes
+    uint64_t render = 0;     // Tile rendering
+    uint64_t readback = 0;   // Color buffer to the host
+    
+    uint64_t total() const { return clear + upload + transform + binning + render + readback; }
+};
+
+struct FrameTimingReport {
+    FrameTimings last;     // The frame last returned by finishFrame
+    FrameTimings average;  // Over the last (up to) 60 frames
+    int frameCount = 0;    // Frames in the average
+};
+
+// Counted by the kernels on sampled frames, see Renderer::setFrameStatsInterval
+struct FrameStats {
+    uint64_t frame = 0;              // Number of the frame (counting finishFrame calls from 0)
+    uint32_t submitted = 0;          // Triangles in the frame
+    uint32_t culledNear = 0;         // A vertex in front of the near plane
+    uint32_t culledDegenerate = 0;   // Projection with (almost) zero area
+    uint32_t culledOffscreen = 0;    // Bounding box outside the screen
+    uint32_t binEntries = 0;         // Triangle ids written to tile lists
+    uint32_t binOverflows = 0;       // Dropped because a tile's slots were full (fixed-slot binning only)
+    uint32_t pixelsTested = 0;       // Pixels inside a triangle that went through the depth test
+    uint32_t pixelsWritten = 0;      // Depth tests passed - more than the covered pixels means overdraw
+};
+
 class Renderer{
     private:
     _Renderer* pimpl;       
     public:
-        Renderer(int scr_s, int scr_h, int scr_z);
+        // framesInFlight: how many frames the device may work on while the CPU prepares the next one
+        // (1 makes finishFrame return the frame that was just rendered)
+        Renderer(int scr_s, int scr_h, int scr_z, int framesInFlight = 2, TuningMode tuning = TUNING_CACHED);
+        Renderer(int scr_s, int scr_h, int scr_z, int framesInFlight, const TileConfig& tiles);
         ~Renderer();
+        // Returns the pixels of the frame submitted framesInFlight - 1 calls ago, waiting for it
+        // if needed - nullptr for the first framesInFlight - 1 calls, which have no frame that old
+        // (finishPendingFrame gets the frames still in flight). Valid until the next call.
+        // The pixels are 0x00RRGGBB, width pixels per row.
         uint32_t *finishFrame();
+        // Same, but hands the returned frame to target (see render_target.hpp).
+        // Returns false, without calling the target, when there was no frame to return.
+        bool finishFrame(RenderTarget& target);
+        // Same, but copies the returned frame into caller memory of height rows of pitch pixels,
+        // e.g. a locked SDL texture. With mapped readback that's the only copy the frame goes through.
+        bool finishFrame(uint32_t* destination, int pitch);
+        // Number of the frame finishFrame or finishPendingFrame returned last, counting from 0
+        uint64_t lastFrameNumber() const;
+        // Waits for the oldest frame still in flight and returns it without submitting a new one,
+        // nullptr once every frame was returned. Gets the last frames out at the end of a batch.
+        uint32_t *finishPendingFrame();
+        // Hands every frame still in flight to target, returns how many there were
+        int finishPendingFrames(RenderTarget& target);
         
         // Modern binning-based rendering methods only
         
         void clear();
         
-        // Binning-based rendering methods - collect triangles and render tiles efficiently
+        // Binning-based rendering methods - collect triangles and render tiles efficiently.
+        // A vertex buffer is copied for the frame when one of its triangles is first submitted,
+        // so writing new vertices into it afterwards is fine, but they only show in the next frame.
         void startNewFrame();
         void submitTriangleForBinning(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx, int color);
             void submitTexturedTriangleForBinning(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx,
                                          const TexCoord& ta, const TexCoord& tb, const TexCoord& tc, const Texture& texture);
+        // Copies vertices into the renderer's per-frame streaming buffer, for geometry the host rebuilds
+        // every frame. All of a frame's streamed vertices go to the device in one write in executeBinningPass().
+        // Indices passed with the returned range are relative to its first vertex.
+        lr::BufferRange<vec> streamVertices(std::span<const vec> vertices);
+        void submitTriangleForBinning(const lr::BufferRange<vec>& vertices, int v0_idx, int v1_idx, int v2_idx, int color);
+        void submitTexturedTriangleForBinning(const lr::BufferRange<vec>& vertices, int v0_idx, int v1_idx, int v2_idx,
+                                              const TexCoord& ta, const TexCoord& tb, const TexCoord& tc, const Texture& texture);
+    // Draw a whole mesh - its vertices are transformed on the GPU with the camera as of startNewFrame()
+    void submitMesh(const Mesh& mesh);
+    // Draw one copy of the mesh per transform. Only the transforms are uploaded (once per frame,
+    // in executeBinningPass()), the copies are expanded on the GPU.
+    void submitInstances(const Mesh& mesh, std::span<const Transform> transforms);
     void executeBinningPass();
     void executeFinishFrameTileBased();  // Render using tile-based approach after binning
     int getBinnedTriangleCount() const;
+    void setBinningMode(BinningMode mode);
+    BinningMode getBinningMode() const;
+    TileConfig getTileConfig() const;  // The configuration in use, with defaults filled in
+    // Reallocates the color buffers for the mode. Waits for the device, frames still in flight are dropped.
+    void setReadbackMode(ReadbackMode mode);
+    ReadbackMode getReadbackMode() const;  // READBACK_COPY or READBACK_MAPPED
+    FrameTimingReport getFrameTimings() const;
+    // Count FrameStats on every frames-th frame (0 turns counting off, the default).
+    // Counting adds atomics to the kernels, frames in between run without them.
+    void setFrameStatsInterval(int frames);
+    // Stats of the latest counted frame that finishFrame returned
+    std::optional<FrameStats> getFrameStats() const;
     
     // Camera management
     void setCamera(const Camera& camera);
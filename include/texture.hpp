@@ -28,7 +28,8 @@ public:
     // This is different from creating a new buffer with copied data.
     // The underlying cl::Buffer is a handle/reference, so multiple Texture objects
     // can safely reference the same GPU memory. The OpenCL buffer memory is managed
-    // by OpenCL's reference counting system.
+    // by OpenCL's reference counting system, and the pool block it lives in by the
+    // shared allocation handle (getAllocation()).
     //
     // If you need independent GPU buffers with the same data, create a new Texture
     // by reading back the data and creating a new instance.
@@ -48,6 +49,7 @@ public:
     
     // Get the underlying OpenCL buffer for kernel usage
     const cl::Buffer& getCLBuffer() const { return buffer.getCLBuffer(); }
+    const std::shared_ptr<const void>& getAllocation() const { return buffer.getAllocation(); }
     
 
 
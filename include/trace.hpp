@@ -0,0 +1,47 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <string>
+
+// Timeline of CPU scopes and device commands, written as Chrome trace-event JSON
+// that loads in chrome://tracing and ui.perfetto.dev.
+// Device commands are only recorded on a profiling queue (LR_TRACE turns profiling on).
+namespace lr {
+    namespace trace {
+        // Starts recording. Events are kept in memory and written to path by stop(), or at exit.
+        void start(const std::string& path);
+        void stop();
+        bool isRecording();
+
+        // Nanoseconds on the clock all trace events use
+        uint64_t now();
+
+        void addCpuEvent(const std::string& name, uint64_t begin, uint64_t end);
+        // begin/end already converted to the trace clock
+        void addDeviceEvent(const std::string& name, const std::string& category, uint64_t begin, uint64_t end);
+
+        // Records the time between construction and destruction on the calling thread
+        class Scope {
+        private:
+            const char* name;
+            uint64_t begin;
+            bool active;
+        public:
+            explicit Scope(const char* name) : name(name), begin(0), active(isRecording()) {
+                if (active) begin = now();
+            }
+            ~Scope() {
+                if (active) addCpuEvent(name, begin, now());
+            }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+        };
+    }
+} // namespace lr
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) lr::trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // TRACE_HPP
@@ -2,9 +2,9 @@
 #define UTIL_HPP
 #define CL_HPP_TARGET_OPENCL_VERSION 300
 #include <cmath> 
+#include <cstdint>
 #include <ostream>
 #include <CL/opencl.hpp>
-#include <SDL2/SDL.h>
 
 // Ensure no padding in vec struct for OpenCL compatibility
 #pragma pack(push, 1)
@@ -64,6 +64,19 @@ vec rotZ(vec v, vec o, float angle);
 
 vec VX(float x, float y, float z);
 
+// Affine 3x4 transform (rotation/scale | translation), row by row - places an instance of a mesh.
+// Rows are 16-byte aligned on the GPU (float4), so this is exactly 3 float4.
+struct Transform {
+    float m[3][4];
+
+    // Scale first, then rotate around Y, then translate
+    Transform(const vec& translation = vec(), const vec& scale = vec(1.0f, 1.0f, 1.0f), float yaw = 0.0f);
+
+    vec apply(const vec& v) const;
+};
+
+static_assert(sizeof(Transform) == 48, "Transform must be exactly 48 bytes (3 float4)");
+
 // RGB color conversion functions
 int fromRgb(int r, int g, int b);
 void toRgb(int color, int &r, int &g, int &b);
@@ -71,7 +84,7 @@ void toRgb(int color, int &r, int &g, int &b);
 bool monitorExecution(cl_int error);
 
 struct tri{
-    Uint32 color;
+    uint32_t color;
     vec *a,*b,*c;
 };
 
@@ -0,0 +1,199 @@
+#include "../include/autotune.hpp"
+#include "../include/mesh.hpp"
+#include "../include/program_cache.hpp"
+#include "../include/log.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const int WARMUP_FRAMES = 3;
+const int TIMED_FRAMES = 12;
+
+std::string tuningFilePath() {
+    std::string directory = ProgramCache::defaultDirectory();
+    return directory.empty() ? "" : directory + "/tile_config.txt";
+}
+
+// One line per device and resolution: "<device>|<driver>|<w>x<h>\t<tile size> <local x> <local y>"
+std::string tuningKey(int scr_w, int scr_h) {
+    cl::Device& device = getGPU().getDevice();
+    return device.getInfo<CL_DEVICE_NAME>() + "|" + device.getInfo<CL_DRIVER_VERSION>() + "|" +
+           std::to_string(scr_w) + "x" + std::to_string(scr_h);
+}
+
+// Quads spread over the screen at different depths - small enough that most tiles see
+// several of them, overlapping enough that the depth test matters
+struct SyntheticScene {
+    Mesh quad;
+    std::vector<Transform> instances;
+
+    static Mesh makeQuad() {
+        const vec vertices[] = {{-0.5f, -0.5f, 0.0f}, {0.5f, -0.5f, 0.0f}, {0.5f, 0.5f, 0.0f}, {-0.5f, 0.5f, 0.0f}};
+        const int indices[] = {0, 1, 2, 0, 2, 3};
+        const int colors[] = {fromRgb(200, 60, 60), fromRgb(60, 200, 60)};
+        return Mesh(vertices, indices, colors);
+    }
+
+    SyntheticScene(int scr_w, int scr_h, int scr_z) : quad(makeQuad()) {
+        const int columns = 48, rows = 27;
+        for (int row = 0; row < rows; row++) {
+            for (int column = 0; column < columns; column++) {
+                float z = 200.0f + 150.0f * ((row * 7 + column * 3) % 13);
+                // Place the quad in screen space, then unproject it at depth z
+                float screenX = ((column + 0.5f) / columns - 0.5f) * scr_w;
+                float screenY = ((row + 0.5f) / rows - 0.5f) * scr_h;
+                float size = 3.0f * scr_w / columns;
+                float unproject = z / scr_z;
+                instances.push_back(Transform(vec(screenX * unproject, screenY * unproject, z),
+                                              vec(size * unproject, size * unproject, 1.0f),
+                                              0.3f * ((row + column) % 5)));
+            }
+        }
+    }
+};
+
+void renderFrame(Renderer& renderer, const SyntheticScene& scene) {
+    renderer.startNewFrame();
+    renderer.clear();
+    renderer.submitInstances(scene.quad, scene.instances);
+    renderer.executeBinningPass();
+    renderer.executeFinishFrameTileBased();
+    renderer.finishFrame();
+}
+
+// Average milliseconds per frame. With one frame in flight finishFrame waits for the device,
+// so this covers the whole frame: upload, binning, tile rendering and readback.
+double timeFrames(Renderer& renderer, const SyntheticScene& scene) {
+    for (int i = 0; i < WARMUP_FRAMES; i++) renderFrame(renderer, scene);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < TIMED_FRAMES; i++) renderFrame(renderer, scene);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / TIMED_FRAMES;
+}
+
+}
+
+TileConfig autotuneTileConfig(int scr_w, int scr_h, int scr_z) {
+    LOG_INFO("Autotuning tile configuration for " + std::to_string(scr_w) + "x" + std::to_string(scr_h));
+    SyntheticScene scene(scr_w, scr_h, scr_z);
+
+    std::vector<TileConfig> candidates;
+    for (int tileSize : {8, 16, 32, 64}) {
+        for (int localX : {tileSize, tileSize / 2}) {
+            for (int localY : {tileSize, tileSize / 2, tileSize / 4, tileSize / 8}) {
+                if (localY < 1 || localX * localY < 32 || localX * localY > 1024) continue;
+                candidates.push_back({tileSize, localX, localY});
+            }
+        }
+    }
+
+    // The renderer shrinks shapes the device can't run - those end up as duplicates and are skipped
+    std::vector<TileConfig> tried;
+    TileConfig best;
+    double bestTime = 0.0;
+    for (const TileConfig& candidate : candidates) {
+        Renderer renderer(scr_w, scr_h, scr_z, 1, candidate);
+        TileConfig applied = renderer.getTileConfig();
+        bool duplicate = false;
+        for (const TileConfig& other : tried) {
+            duplicate |= other.tileSize == applied.tileSize && other.localX == applied.localX && other.localY == applied.localY;
+        }
+        if (duplicate) continue;
+        tried.push_back(applied);
+
+        double time = timeFrames(renderer, scene);
+
+        LOG_DEBUG("Tile " + std::to_string(applied.tileSize) + ", work-group " + std::to_string(applied.localX) + "x" +
+                  std::to_string(applied.localY) + ": " + std::to_string(time) + " ms/frame");
+        if (bestTime == 0.0 || time < bestTime) {
+            bestTime = time;
+            best = applied;
+        }
+    }
+
+    LOG_INFO("Best tile configuration: tile " + std::to_string(best.tileSize) + ", work-group " +
+             std::to_string(best.localX) + "x" + std::to_string(best.localY) + " (" + std::to_string(bestTime) + " ms/frame)");
+    return best;
+}
+
+std::optional<TileConfig> loadTileConfig(int scr_w, int scr_h) {
+    std::string path = tuningFilePath();
+    if (path.empty()) return std::nullopt;
+    std::ifstream file(path);
+    if (!file.is_open()) return std::nullopt;
+
+    std::string key = tuningKey(scr_w, scr_h);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, key.size() + 1, key + "\t") != 0) continue;
+        TileConfig config;
+        std::istringstream values(line.substr(key.size() + 1));
+        if (values >> config.tileSize >> config.localX >> config.localY) return config;
+    }
+    return std::nullopt;
+}
+
+void storeTileConfig(int scr_w, int scr_h, const TileConfig& config) {
+    std::string path = tuningFilePath();
+    if (path.empty()) return;
+
+    // Keep the entries of other devices and resolutions
+    std::string key = tuningKey(scr_w, scr_h);
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.compare(0, key.size() + 1, key + "\t") != 0) lines.push_back(line);
+        }
+    }
+    lines.push_back(key + "\t" + std::to_string(config.tileSize) + " " + std::to_string(config.localX) + " " + std::to_string(config.localY));
+
+    std::error_code err;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), err);
+    std::string tmpPath = ProgramCache::temporaryPath(path);
+    {
+        std::ofstream file(tmpPath);
+        for (const std::string& line : lines) file << line << '\n';
+        if (!file) {
+            LOG_ERR("Failed to write tile configuration " + tmpPath);
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, err);
+    if (err) {
+        LOG_ERR("Failed to store tile configuration " + path + ": " + err.message());
+        std::remove(tmpPath.c_str());
+    }
+}
+
+TileConfig resolveTileConfig(int scr_w, int scr_h, int scr_z, TuningMode mode) {
+    if (const char* value = std::getenv("LR_AUTOTUNE")) {
+        std::string name = value;
+        if (name == "off") mode = TUNING_OFF;
+        else if (name == "cached") mode = TUNING_CACHED;
+        else if (name == "auto" || name == "1") mode = TUNING_AUTO;
+        else if (name == "force") mode = TUNING_FORCE;
+        else LOG_ERR("Unknown LR_AUTOTUNE value '" + name + "' - ignored");
+    }
+
+    if (mode == TUNING_OFF) return {};
+    if (mode != TUNING_FORCE) {
+        if (std::optional<TileConfig> stored = loadTileConfig(scr_w, scr_h)) {
+            LOG_DEBUG("Using stored tile configuration: tile " + std::to_string(stored->tileSize));
+            return *stored;
+        }
+        if (mode == TUNING_CACHED) return {};
+    }
+    TileConfig best = autotuneTileConfig(scr_w, scr_h, scr_z);
+    storeTileConfig(scr_w, scr_h, best);
+    return best;
+}
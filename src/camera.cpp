@@ -109,7 +109,12 @@ vec Camera::transformVertex(const vec& worldVertex) const {
         worldVertex.z - z
     };
     
-    // Step 2: Apply inverse rotation (rotate by -yaw, -pitch, -roll)
+    // Step 2: Apply inverse rotation
+    return rotateToCamera(translated);
+}
+
+vec Camera::rotateToCamera(const vec& translated) const {
+    // Apply inverse rotation (rotate by -yaw, -pitch, -roll)
     // We apply rotations in reverse order: roll -> pitch -> yaw
     
     float cosYaw = cos(-yaw);
@@ -139,4 +144,18 @@ vec Camera::transformVertex(const vec& worldVertex) const {
     result.z = -tempX * sinYaw + tempZ * cosYaw;
     
     return result;
-} 
\ No newline at end of file
+}
+
+void Camera::getViewMatrix(float rows[3][4]) const {
+    // The rotation is linear, so its columns are the rotated basis vectors
+    vec columns[3] = {
+        rotateToCamera(vec(1.0f, 0.0f, 0.0f)),
+        rotateToCamera(vec(0.0f, 1.0f, 0.0f)),
+        rotateToCamera(vec(0.0f, 0.0f, 1.0f))
+    };
+    vec translation = rotateToCamera(vec(-x, -y, -z));
+    
+    rows[0][0] = columns[0].x; rows[0][1] = columns[1].x; rows[0][2] = columns[2].x; rows[0][3] = translation.x;
+    rows[1][0] = columns[0].y; rows[1][1] = columns[1].y; rows[1][2] = columns[2].y; rows[1][3] = translation.y;
+    rows[2][0] = columns[0].z; rows[2][1] = columns[1].z; rows[2][2] = columns[2].z; rows[2][3] = translation.z;
+}
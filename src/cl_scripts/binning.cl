@@ -2,43 +2,97 @@
 // This file contains kernels for the binning pass that determines which screen tiles 
 // each triangle affects, enabling tile-based rendering
 
-// Screen tile configuration
+// Screen tile configuration. The renderer passes both with -D, these are only the fallbacks.
+#ifndef TILE_SIZE
 #define TILE_SIZE 32           // Each tile is 32x32 pixels
-#define MAX_TRIANGLES_PER_TILE 256  // Maximum triangles that can be assigned to a tile
+#endif
+#ifndef MAX_TRIANGLES_PER_TILE
+#define MAX_TRIANGLES_PER_TILE 256  // Maximum triangles per tile in the fixed-slot binning mode
+#endif
 
-// Tile data structure - contains list of triangle IDs affecting this tile
-typedef struct __attribute__((packed)) {
-    int triangle_ids[MAX_TRIANGLES_PER_TILE];  // Triangle IDs in this tile
-    int triangle_count;                        // Number of triangles in this tile
-} TileData;
+// The tile grid follows from the screen size, see SPECIALIZE_SCREEN in common.cl
+#ifdef SCREEN_WIDTH
+#define SPECIALIZE_TILES_PER_ROW(tiles) tiles = (SCREEN_WIDTH + TILE_SIZE - 1) / TILE_SIZE
+#define SPECIALIZE_TILES_PER_COLUMN(tiles) tiles = (SCREEN_HEIGHT + TILE_SIZE - 1) / TILE_SIZE
+#else
+#define SPECIALIZE_TILES_PER_ROW(tiles)
+#define SPECIALIZE_TILES_PER_COLUMN(tiles)
+#endif
 
-// Kernel that processes each triangle and determines which tiles it affects
-__kernel void binTriangles(__global TriangleData* triangles,
-                          int triangle_count,
-                          __global TileData* tiles, 
-                          int screen_width, int screen_height,
-                          int tiles_per_row, int tiles_per_column) {
+// Tile lists come in two layouts, picked by the Binner's mode:
+//  - fixed slots:  tile t owns triangle_ids[t*MAX_TRIANGLES_PER_TILE ...], tile_counts[t]
+//                  says how many were added (may exceed the slot count - the rest is dropped)
+//  - prefix sum:   tile t owns triangle_ids[tile_offsets[t] ... tile_offsets[t+1]).
+//                  A tile whose list doesn't fit into triangle_ids gets no list, its offset
+//                  is stored as LIST_OVERFLOWED(offset) and renderTile tests every triangle
+//                  of the frame for it instead - nothing is dropped.
+
+// Offsets of the tiles without a list are negative, so the end of the list before them can still be found
+#define LIST_OVERFLOWED(offset) (-1 - (offset))
+#define LIST_OFFSET(stored) ((stored) >= 0 ? (stored) : -1 - (stored))
+
+// Result of the triangle setup pass
+#define TRIANGLE_ACCEPTED           0
+#define TRIANGLE_CULLED_NEAR        1  // A vertex is in front of the near plane
+#define TRIANGLE_CULLED_DEGENERATE  2  // Projection has (almost) zero area
+#define TRIANGLE_CULLED_OFFSCREEN   3  // Bounding box doesn't touch the screen
+
+// Per-triangle data precomputed once by setupTriangles.
+// Binning and tile rendering read only this, never the vertex buffers.
+// Every attribute is stored as a plane over screen space: a(x,y) = a_dx*x + a_dy*y + a_c,
+// so the screen-space vertices are folded into the edge coefficients.
+// Must match GPUTriangleSetup in rendering2.cpp.
+typedef struct {
+    float l1_dx, l1_dy, l1_c;        // Barycentric weight of vertex 0 (edge v1-v2)
+    float l2_dx, l2_dy, l2_c;        // Barycentric weight of vertex 1 (edge v2-v0)
+    float iz_dx, iz_dy, iz_c;        // Interpolated 1/z
+    float u_dx, u_dy, u_c;           // Texture coordinate u
+    float v_dx, v_dy, v_c;           // Texture coordinate v
+    int min_x, min_y, max_x, max_y;  // Bounding box in screen coordinates, clipped to the screen
+    int state;                       // TRIANGLE_ACCEPTED or the reason it was rejected
+    int color;                       // Solid color
+    int tex_offset;                  // First texel in the texture pool (-1 for solid color)
+    int tex_width, tex_height;       // Texture dimensions
+} TriangleSetup;
+
+// Projects every triangle once and computes its edge equations, 1/z plane and bounding box
+__kernel void setupTriangles(__global TriangleData* triangles,
+                             int triangle_count,
+                             __global TriangleSetup* setups,
+                             __global packed_vec3* vertices,
+                             int screen_width, int screen_height,
+                             float scr_z,
+                             __global uint* stats) {
+    SPECIALIZE_SCREEN(screen_width, screen_height);
+    SPECIALIZE_SCR_Z(scr_z);
     
     int triangle_id = get_global_id(0);
     if (triangle_id >= triangle_count) return;
     
     TriangleData triangle = triangles[triangle_id];
     
-    // Get the three vertices from the triangle's vertex buffer
-    packed_vec3 v0 = triangle.vertexBuffer[triangle.v0_idx];
-    packed_vec3 v1 = triangle.vertexBuffer[triangle.v1_idx];
-    packed_vec3 v2 = triangle.vertexBuffer[triangle.v2_idx];
+    TriangleSetup setup;
+    setup.color = triangle.color;
+    setup.tex_offset = triangle.tex_offset;
+    setup.tex_width = triangle.tex_width;
+    setup.tex_height = triangle.tex_height;
+    
+    // Get the three vertices from the vertex pool
+    packed_vec3 v0 = vertices[triangle.v0_idx];
+    packed_vec3 v1 = vertices[triangle.v1_idx];
+    packed_vec3 v2 = vertices[triangle.v2_idx];
     
-    // Project vertices to screen space (same logic as in rasterization)
     float z1 = v0.z, z2 = v1.z, z3 = v2.z;
     
     // Cull triangles too close to camera
-    if(z1 < 10 || z2 < 10 || z3 < 10) {
+    if(z1 < NEAR_PLANE_Z || z2 < NEAR_PLANE_Z || z3 < NEAR_PLANE_Z) {
+        setup.state = TRIANGLE_CULLED_NEAR;
+        ADD_STAT(stats, STAT_CULLED_NEAR, 1);
+        setups[triangle_id] = setup;
         return;
     }
     
     // Project to screen space
-    float scr_z = 1000.0f;
     float x1 = v0.x * scr_z / fabs(z1);
     float y1 = -v0.y * scr_z / fabs(z1);
     float x2 = v1.x * scr_z / fabs(z2);
@@ -46,125 +100,377 @@ __kernel void binTriangles(__global TriangleData* triangles,
     float x3 = v2.x * scr_z / fabs(z3);
     float y3 = -v2.y * scr_z / fabs(z3);
     
-    // Calculate triangle bounding box in screen space
-    int boxLeft = (int)fmin(fmin(x1, x2), x3);
-    int boxRight = (int)fmax(fmax(x1, x2), x3);
-    int boxTop = (int)fmin(fmin(y1, y2), y3);
-    int boxBottom = (int)fmax(fmax(y1, y2), y3);
+    float denom = (x2 - x3) * (y1 - y3) + (y3 - y2) * (x1 - x3);
+    if(fabs(denom) < 0.001f) {
+        setup.state = TRIANGLE_CULLED_DEGENERATE;
+        ADD_STAT(stats, STAT_CULLED_DEGENERATE, 1);
+        setups[triangle_id] = setup;
+        return;
+    }
+    
+    // Bounding box, clipped to the screen (screen center is at (0,0))
+    float screen_left = -(screen_width / 2), screen_right = screen_width - screen_width / 2 - 1;
+    float screen_top = -(screen_height / 2), screen_bottom = screen_height - screen_height / 2 - 1;
+    float boxLeft = fmin(fmin(x1, x2), x3);
+    float boxRight = fmax(fmax(x1, x2), x3);
+    float boxTop = fmin(fmin(y1, y2), y3);
+    float boxBottom = fmax(fmax(y1, y2), y3);
+    if (boxRight < screen_left || boxLeft > screen_right || boxBottom < screen_top || boxTop > screen_bottom) {
+        setup.state = TRIANGLE_CULLED_OFFSCREEN;
+        ADD_STAT(stats, STAT_CULLED_OFFSCREEN, 1);
+        setups[triangle_id] = setup;
+        return;
+    }
+    setup.min_x = (int)fmax(boxLeft, screen_left);
+    setup.max_x = (int)fmin(boxRight, screen_right);
+    setup.min_y = (int)fmax(boxTop, screen_top);
+    setup.max_y = (int)fmin(boxBottom, screen_bottom);
+    
+    // Barycentric coordinates as planes:
+    //   l1 = ((x2 - x3) * (y - y3) + (y3 - y2) * (x - x3)) / denom
+    //   l2 = ((x3 - x1) * (y - y3) + (y1 - y3) * (x - x3)) / denom
+    //   l3 = 1 - l1 - l2
+    float inv_denom = 1.0f / denom;
+    setup.l1_dx = (y3 - y2) * inv_denom;
+    setup.l1_dy = (x2 - x3) * inv_denom;
+    setup.l1_c = -(setup.l1_dx * x3 + setup.l1_dy * y3);
+    setup.l2_dx = (y1 - y3) * inv_denom;
+    setup.l2_dy = (x3 - x1) * inv_denom;
+    setup.l2_c = -(setup.l2_dx * x3 + setup.l2_dy * y3);
+    float l3_dx = -setup.l1_dx - setup.l2_dx;
+    float l3_dy = -setup.l1_dy - setup.l2_dy;
+    float l3_c = 1.0f - setup.l1_c - setup.l2_c;
+    
+    // Any attribute interpolated with l1,l2,l3 is a plane too
+    float w1 = 1.0f / z1, w2 = 1.0f / z2, w3 = 1.0f / z3;
+    setup.iz_dx = setup.l1_dx * w1 + setup.l2_dx * w2 + l3_dx * w3;
+    setup.iz_dy = setup.l1_dy * w1 + setup.l2_dy * w2 + l3_dy * w3;
+    setup.iz_c = setup.l1_c * w1 + setup.l2_c * w2 + l3_c * w3;
+    
+    setup.u_dx = setup.l1_dx * triangle.tex_coords[0] + setup.l2_dx * triangle.tex_coords[2] + l3_dx * triangle.tex_coords[4];
+    setup.u_dy = setup.l1_dy * triangle.tex_coords[0] + setup.l2_dy * triangle.tex_coords[2] + l3_dy * triangle.tex_coords[4];
+    setup.u_c = setup.l1_c * triangle.tex_coords[0] + setup.l2_c * triangle.tex_coords[2] + l3_c * triangle.tex_coords[4];
+    setup.v_dx = setup.l1_dx * triangle.tex_coords[1] + setup.l2_dx * triangle.tex_coords[3] + l3_dx * triangle.tex_coords[5];
+    setup.v_dy = setup.l1_dy * triangle.tex_coords[1] + setup.l2_dy * triangle.tex_coords[3] + l3_dy * triangle.tex_coords[5];
+    setup.v_c = setup.l1_c * triangle.tex_coords[1] + setup.l2_c * triangle.tex_coords[3] + l3_c * triangle.tex_coords[5];
     
+    setup.state = TRIANGLE_ACCEPTED;
+    setups[triangle_id] = setup;
+}
+
+// Range of tiles covered by the bounding box of an accepted triangle
+void getTileRange(__global TriangleSetup* setup,
+                  int screen_width, int screen_height,
+                  int tiles_per_row, int tiles_per_column,
+                  int* tile_left, int* tile_right, int* tile_top, int* tile_bottom) {
     // Convert screen coordinates to tile coordinates
     // Screen center is at (0,0), so adjust for tile grid
     int screen_center_x = screen_width / 2;
     int screen_center_y = screen_height / 2;
     
-    int tile_left = (boxLeft + screen_center_x) / TILE_SIZE;
-    int tile_right = (boxRight + screen_center_x) / TILE_SIZE;
-    int tile_top = (boxTop + screen_center_y) / TILE_SIZE;
-    int tile_bottom = (boxBottom + screen_center_y) / TILE_SIZE;
-    
     // Clamp to valid tile ranges
-    tile_left = max(0, min(tile_left, tiles_per_row - 1));
-    tile_right = max(0, min(tile_right, tiles_per_row - 1));
-    tile_top = max(0, min(tile_top, tiles_per_column - 1));
-    tile_bottom = max(0, min(tile_bottom, tiles_per_column - 1));
+    *tile_left = max(0, min((setup->min_x + screen_center_x) / TILE_SIZE, tiles_per_row - 1));
+    *tile_right = max(0, min((setup->max_x + screen_center_x) / TILE_SIZE, tiles_per_row - 1));
+    *tile_top = max(0, min((setup->min_y + screen_center_y) / TILE_SIZE, tiles_per_column - 1));
+    *tile_bottom = max(0, min((setup->max_y + screen_center_y) / TILE_SIZE, tiles_per_column - 1));
+}
+
+// Fixed-slot binning: every tile has room for MAX_TRIANGLES_PER_TILE triangles
+__kernel void binTriangles(__global TriangleSetup* setups,
+                          int triangle_count,
+                          __global int* tile_counts,
+                          __global int* tile_triangle_ids,
+                          int screen_width, int screen_height,
+                          int tiles_per_row, int tiles_per_column,
+                          __global uint* stats) {
+    SPECIALIZE_SCREEN(screen_width, screen_height);
+    SPECIALIZE_TILES_PER_ROW(tiles_per_row);
+    SPECIALIZE_TILES_PER_COLUMN(tiles_per_column);
+    
+    int triangle_id = get_global_id(0);
+    if (triangle_id >= triangle_count) return;
+    
+    __global TriangleSetup* setup = &setups[triangle_id];
+    if (setup->state != TRIANGLE_ACCEPTED) return;
+    
+    int tile_left, tile_right, tile_top, tile_bottom;
+    getTileRange(setup, screen_width, screen_height, tiles_per_row, tiles_per_column,
+                 &tile_left, &tile_right, &tile_top, &tile_bottom);
     
     // Add this triangle to all tiles it overlaps
+    int entries = 0, overflows = 0;
     for (int ty = tile_top; ty <= tile_bottom; ty++) {
         for (int tx = tile_left; tx <= tile_right; tx++) {
             int tile_index = ty * tiles_per_row + tx;
             
             // Atomically add triangle to tile's list
-            int slot = atomic_inc(&tiles[tile_index].triangle_count);
+            int slot = atomic_inc(&tile_counts[tile_index]);
             if (slot < MAX_TRIANGLES_PER_TILE) {
-                tiles[tile_index].triangle_ids[slot] = triangle_id;
+                tile_triangle_ids[tile_index * MAX_TRIANGLES_PER_TILE + slot] = triangle_id;
+                entries++;
+            } else {
+                // If tile is full, triangles will be dropped
+                overflows++;
             }
-            // If tile is full, triangles will be dropped (could add overflow handling)
+        }
+    }
+    ADD_STAT(stats, STAT_BIN_ENTRIES, entries);
+    ADD_STAT(stats, STAT_BIN_OVERFLOWS, overflows);
+}
+
+// Prefix-sum binning, pass 1: count how many triangles cover every tile
+__kernel void countTileCoverage(__global TriangleSetup* setups,
+                                int triangle_count,
+                                __global int* tile_counts,
+                                int screen_width, int screen_height,
+                                int tiles_per_row, int tiles_per_column) {
+    SPECIALIZE_SCREEN(screen_width, screen_height);
+    SPECIALIZE_TILES_PER_ROW(tiles_per_row);
+    SPECIALIZE_TILES_PER_COLUMN(tiles_per_column);
+    
+    int triangle_id = get_global_id(0);
+    if (triangle_id >= triangle_count) return;
+    
+    __global TriangleSetup* setup = &setups[triangle_id];
+    if (setup->state != TRIANGLE_ACCEPTED) return;
+    
+    int tile_left, tile_right, tile_top, tile_bottom;
+    getTileRange(setup, screen_width, screen_height, tiles_per_row, tiles_per_column,
+                 &tile_left, &tile_right, &tile_top, &tile_bottom);
+    
+    for (int ty = tile_top; ty <= tile_bottom; ty++) {
+        for (int tx = tile_left; tx <= tile_right; tx++) {
+            atomic_inc(&tile_counts[ty * tiles_per_row + tx]);
         }
     }
 }
 
-// Clear tile data before binning pass
-__kernel void clearTiles(__global TileData* tiles, int total_tiles) {
+// Prefix-sum binning, pass 2: exclusive prefix sum of the tile counts.
+// Runs as a single work-group. Every work-item sums a contiguous chunk of tiles,
+// the chunk sums are scanned in local memory and then every work-item writes
+// the offsets of its chunk. Tiles whose list would end past list_capacity are marked with
+// LIST_OVERFLOWED. tile_offsets[total_tiles] receives the total list length - it can be larger
+// than list_capacity, the host sizes the next frame's list from it.
+// tile_counts is turned into the write cursors used by scatterTriangles.
+__kernel void scanTileCounts(__global int* tile_counts,
+                             __global int* tile_offsets,
+                             int total_tiles,
+                             int list_capacity,
+                             __local int* partial_sums) {
+    
+    int lid = get_local_id(0);
+    int group_size = get_local_size(0);
+    int chunk = (total_tiles + group_size - 1) / group_size;
+    int begin = min(lid * chunk, total_tiles);
+    int end = min(begin + chunk, total_tiles);
+    
+    int sum = 0;
+    for (int i = begin; i < end; i++) {
+        sum += tile_counts[i];
+    }
+    partial_sums[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    
+    // Inclusive scan of the chunk sums
+    for (int offset = 1; offset < group_size; offset <<= 1) {
+        int value = lid >= offset ? partial_sums[lid - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        partial_sums[lid] += value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    
+    int running = partial_sums[lid] - sum;
+    for (int i = begin; i < end; i++) {
+        int count = tile_counts[i];
+        tile_offsets[i] = running + count <= list_capacity ? running : LIST_OVERFLOWED(running);
+        tile_counts[i] = running;
+        running += count;
+    }
+    if (lid == group_size - 1) {
+        tile_offsets[total_tiles] = partial_sums[lid];
+    }
+}
+
+// Prefix-sum binning, pass 3: write triangle IDs into the compact tile lists.
+// Tiles marked with LIST_OVERFLOWED are skipped, renderTile doesn't need their lists.
+__kernel void scatterTriangles(__global TriangleSetup* setups,
+                               int triangle_count,
+                               __global int* tile_cursors,
+                               __global int* tile_offsets,
+                               __global int* tile_triangle_ids,
+                               int screen_width, int screen_height,
+                               int tiles_per_row, int tiles_per_column,
+                               __global uint* stats) {
+    SPECIALIZE_SCREEN(screen_width, screen_height);
+    SPECIALIZE_TILES_PER_ROW(tiles_per_row);
+    SPECIALIZE_TILES_PER_COLUMN(tiles_per_column);
+    
+    int triangle_id = get_global_id(0);
+    if (triangle_id >= triangle_count) return;
+    
+    __global TriangleSetup* setup = &setups[triangle_id];
+    if (setup->state != TRIANGLE_ACCEPTED) return;
+    
+    int tile_left, tile_right, tile_top, tile_bottom;
+    getTileRange(setup, screen_width, screen_height, tiles_per_row, tiles_per_column,
+                 &tile_left, &tile_right, &tile_top, &tile_bottom);
+    
+    int entries = 0;
+    for (int ty = tile_top; ty <= tile_bottom; ty++) {
+        for (int tx = tile_left; tx <= tile_right; tx++) {
+            int tile_index = ty * tiles_per_row + tx;
+            if (tile_offsets[tile_index] < 0) continue;
+            int slot = atomic_inc(&tile_cursors[tile_index]);
+            tile_triangle_ids[slot] = triangle_id;
+            entries++;
+        }
+    }
+    ADD_STAT(stats, STAT_BIN_ENTRIES, entries);
+}
+
+// Clear tile counters before binning pass
+__kernel void clearTiles(__global int* tile_counts, int total_tiles) {
     int tile_id = get_global_id(0);
     if (tile_id >= total_tiles) return;
     
-    tiles[tile_id].triangle_count = 0;
-    // Note: We don't need to clear the triangle_ids array as triangle_count tracks valid entries
+    tile_counts[tile_id] = 0;
+    // Note: We don't need to clear the triangle ID lists as the counts track valid entries
 }
 
-// Kernel that renders a specific tile using the triangles assigned to it
+// Number of triangle setups a work-group stages in local memory at once (96 bytes each)
+#define SETUP_CHUNK_SIZE 64
+
+// Kernel that renders the whole tile grid in a single dispatch.
+// Every work-group shades one tile, the tile is taken from the group id, so the
+// global size is (tiles_per_row * local_size_x, tiles_per_column * local_size_y).
+// When the device can't fit a whole tile into one work-group, each work-item
+// walks over the tile in strides of the work-group size.
+// tile_stride selects the tile list layout: MAX_TRIANGLES_PER_TILE for fixed slots
+// (tile_index holds the counts), 0 for prefix sum (tile_index holds the offsets).
+// Prefix-sum tiles without a list go through all setup_count triangle setups instead.
+// The tile's triangle setups are loaded cooperatively into local memory, SETUP_CHUNK_SIZE at a time.
+// Every work-item keeps depth and color of its pixel in registers and writes them back once.
+// Built with -D UNTEXTURED, the texture path is compiled out - the renderer picks that variant
+// for frames without textured triangles.
 __kernel void renderTile(__global float* depthBuffer, __global int* colorArray,
                         int screen_width, int screen_height,
-                        __global TileData* tiles, __global TriangleData* triangles,
-                        int tile_x, int tile_y, int tiles_per_row) {
+                        int tiles_per_row,
+                        __global int* tile_index_data, __global int* tile_triangle_ids, int tile_stride,
+                        __global TriangleSetup* setups, __global int* texture_pool,
+                        __global uint* stats, int setup_count) {
+    SPECIALIZE_SCREEN(screen_width, screen_height);
+    SPECIALIZE_TILES_PER_ROW(tiles_per_row);
     
-    // Get pixel coordinates within the tile
-    int local_x = get_global_id(0);  // 0 to TILE_SIZE-1
-    int local_y = get_global_id(1);  // 0 to TILE_SIZE-1
+    __local TriangleSetup chunk[SETUP_CHUNK_SIZE];
     
-    if (local_x >= TILE_SIZE || local_y >= TILE_SIZE) return;
+    int tile_x = get_group_id(0);
+    int tile_y = get_group_id(1);
+    int tile_index = tile_y * tiles_per_row + tile_x;
+    int local_id = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    int group_size = get_local_size(0) * get_local_size(1);
     
-    // Convert to screen coordinates
-    int screen_x = tile_x * TILE_SIZE + local_x - screen_width/2;
-    int screen_y = tile_y * TILE_SIZE + local_y - screen_height/2;
-    int pixel_index = (screen_y + screen_height/2) * screen_width + (screen_x + screen_width/2);
+    int pixels_tested = 0, pixels_written = 0;
     
-    // Get the tile data
-    int tile_index = tile_y * tiles_per_row + tile_x;
-    TileData tile = tiles[tile_index];
-    
-    // Process all triangles assigned to this tile
-    for (int i = 0; i < tile.triangle_count && i < MAX_TRIANGLES_PER_TILE; i++) {
-        int triangle_id = tile.triangle_ids[i];
-        TriangleData triangle = triangles[triangle_id];
-        
-        // Get vertices and project them (similar to rasterization kernels)
-        packed_vec3 v0 = triangle.vertexBuffer[triangle.v0_idx];
-        packed_vec3 v1 = triangle.vertexBuffer[triangle.v1_idx];
-        packed_vec3 v2 = triangle.vertexBuffer[triangle.v2_idx];
-        
-        float z1 = v0.z, z2 = v1.z, z3 = v2.z;
-        if(z1 < 10 || z2 < 10 || z3 < 10) continue;
-        
-        float scr_z = 1000.0f;
-        float x1 = v0.x * scr_z / fabs(z1);
-        float y1 = -v0.y * scr_z / fabs(z1);
-        float x2 = v1.x * scr_z / fabs(z2);
-        float y2 = -v1.y * scr_z / fabs(z2);
-        float x3 = v2.x * scr_z / fabs(z3);
-        float y3 = -v2.y * scr_z / fabs(z3);
-        
-        // Calculate barycentric coordinates for current pixel
-        float denom = (x2 - x3) * (y1 - y3) + (y3 - y2) * (x1 - x3);
-        if(fabs(denom) < 0.001f) continue; // Degenerate triangle
-        
-        float l1 = ((x2 - x3) * (screen_y - y3) + (y3 - y2) * (screen_x - x3)) / denom;
-        float l2 = ((x3 - x1) * (screen_y - y3) + (y1 - y3) * (screen_x - x3)) / denom;
-        float l3 = 1.0f - l1 - l2;
-        
-        // Test if pixel is inside triangle
-        if(l1 >= 0 && l2 >= 0 && l3 >= 0) {
-            // Interpolate depth
-            float inv_z = l1 * (1.0f/z1) + l2 * (1.0f/z2) + l3 * (1.0f/z3);
+    int list_begin, triangle_count;
+    bool all_setups = false;  // No list - every setup of the frame is tested
+    if (tile_stride > 0) {
+        // Triangles past the slot count were dropped by the binning pass
+        list_begin = tile_index * tile_stride;
+        triangle_count = min(tile_index_data[tile_index], tile_stride);
+    } else if (tile_index_data[tile_index] < 0) {
+        all_setups = true;
+        list_begin = 0;
+        triangle_count = setup_count;
+    } else {
+        list_begin = tile_index_data[tile_index];
+        triangle_count = LIST_OFFSET(tile_index_data[tile_index + 1]) - list_begin;
+    }
+    
+    // The local size divides TILE_SIZE, so every work-item runs the same number of passes
+    // and all of them reach the barriers below
+    for (int local_y = get_local_id(1); local_y < TILE_SIZE; local_y += get_local_size(1)) {
+        for (int local_x = get_local_id(0); local_x < TILE_SIZE; local_x += get_local_size(0)) {
+            
+            // Tiles on the right/bottom edge can stick out of the screen
+            int pixel_x = tile_x * TILE_SIZE + local_x;
+            int pixel_y = tile_y * TILE_SIZE + local_y;
+            bool on_screen = pixel_x < screen_width && pixel_y < screen_height;
+            
+            // Convert to screen coordinates
+            int screen_x = pixel_x - screen_width/2;
+            int screen_y = pixel_y - screen_height/2;
+            int pixel_index = pixel_y * screen_width + pixel_x;
+            float fx = (float)screen_x, fy = (float)screen_y;
+            
+            float depth = on_screen ? depthBuffer[pixel_index] : 0.0f;
+            int color = 0;
+            bool covered = false;
             
-            // Test depth and update pixel if closer
-            if (inv_z < 800 && inv_z > depthBuffer[pixel_index]) {
-                depthBuffer[pixel_index] = inv_z;
+            // Process all triangles assigned to this tile, one chunk at a time
+            for (int chunk_begin = 0; chunk_begin < triangle_count; chunk_begin += SETUP_CHUNK_SIZE) {
+                int chunk_count = min(SETUP_CHUNK_SIZE, triangle_count - chunk_begin);
                 
-                // Handle textured vs solid color triangles
-                if (triangle.texture != 0) {
-                    // Textured triangle - interpolate texture coordinates
-                    float u = l1 * triangle.tex_coords[0] + l2 * triangle.tex_coords[2] + l3 * triangle.tex_coords[4];
-                    float v = l1 * triangle.tex_coords[1] + l2 * triangle.tex_coords[3] + l3 * triangle.tex_coords[5];
+                barrier(CLK_LOCAL_MEM_FENCE);  // Everyone is done with the previous chunk
+                for (int i = local_id; i < chunk_count; i += group_size) {
+                    int setup_index = list_begin + chunk_begin + i;
+                    chunk[i] = setups[all_setups ? setup_index : tile_triangle_ids[setup_index]];
+                }
+                barrier(CLK_LOCAL_MEM_FENCE);
+                
+                if (!on_screen) continue;
+                
+                for (int i = 0; i < chunk_count; i++) {
+                    __local TriangleSetup* setup = &chunk[i];
+                    
+                    // The lists only hold accepted triangles
+                    if (all_setups && setup->state != TRIANGLE_ACCEPTED) continue;
+                    if (screen_x < setup->min_x || screen_x > setup->max_x ||
+                        screen_y < setup->min_y || screen_y > setup->max_y) continue;
+                    
+                    // Barycentric coordinates of the current pixel
+                    float l1 = fma(setup->l1_dx, fx, fma(setup->l1_dy, fy, setup->l1_c));
+                    float l2 = fma(setup->l2_dx, fx, fma(setup->l2_dy, fy, setup->l2_c));
+                    float l3 = 1.0f - l1 - l2;
                     
-                    // Sample texture
-                    int texColor = sampleTexture(triangle.texture, triangle.tex_width, triangle.tex_height, u, v);
-                    colorArray[pixel_index] = texColor;
-                } else {
-                    // Solid color triangle
-                    colorArray[pixel_index] = triangle.color;
+                    // Test if pixel is inside triangle
+                    if(l1 >= 0 && l2 >= 0 && l3 >= 0) {
+                        // Interpolate depth
+                        float inv_z = fma(setup->iz_dx, fx, fma(setup->iz_dy, fy, setup->iz_c));
+                        pixels_tested++;
+                        
+                        // Test depth and update pixel if closer
+                        if (inv_z < 800 && inv_z > depth) {
+                            depth = inv_z;
+                            covered = true;
+                            pixels_written++;
+                            
+#ifndef UNTEXTURED
+                            // Handle textured vs solid color triangles
+                            if (setup->tex_offset >= 0) {
+                                // Textured triangle - interpolate texture coordinates
+                                float u = fma(setup->u_dx, fx, fma(setup->u_dy, fy, setup->u_c));
+                                float v = fma(setup->v_dx, fx, fma(setup->v_dy, fy, setup->v_c));
+                                
+                                // Sample texture
+                                color = sampleTexture(texture_pool + setup->tex_offset, setup->tex_width, setup->tex_height, u, v);
+                                continue;
+                            }
+#endif
+                            // Solid color triangle
+                            color = setup->color;
+                        }
+                    }
                 }
             }
+            
+            // Pixels no triangle covered keep what's in the buffers
+            if (covered) {
+                depthBuffer[pixel_index] = depth;
+                colorArray[pixel_index] = color;
+            }
         }
     }
-} 
\ No newline at end of file
+    
+    ADD_STAT(stats, STAT_PIXELS_TESTED, pixels_tested);
+    ADD_STAT(stats, STAT_PIXELS_WRITTEN, pixels_written);
+}
@@ -1,5 +1,41 @@
 typedef float3 vec3;
 
+// Kernel variants: the host can build the program with -D SCREEN_WIDTH=.. -D SCREEN_HEIGHT=.. -D SCR_Z=..
+// (TILE_SIZE and MAX_TRIANGLES_PER_TILE are in binning.cl). Kernels then ignore the matching
+// arguments and use the constants, so the compiler can fold them into index math and loop bounds.
+#ifdef SCREEN_WIDTH
+#define SPECIALIZE_SCREEN(width, height) width = SCREEN_WIDTH; height = SCREEN_HEIGHT
+#else
+#define SPECIALIZE_SCREEN(width, height)
+#endif
+
+#ifdef SCR_Z
+#define SPECIALIZE_SCR_Z(scr_z) scr_z = SCR_Z
+#define LEGACY_SCR_Z SCR_Z
+#else
+#define SPECIALIZE_SCR_Z(scr_z)
+#define LEGACY_SCR_Z 1000.0f  // Projection distance of the draw* kernels, which take no argument for it
+#endif
+
+// Frame statistics counters (must match FrameStatCounter in rendering2.cpp).
+// Kernels get a NULL stats pointer on frames that aren't counted, so the counting costs
+// a uniform branch there. Counts are summed privately and added with one atomic per work-item.
+#define STAT_CULLED_NEAR        0
+#define STAT_CULLED_DEGENERATE  1
+#define STAT_CULLED_OFFSCREEN   2
+#define STAT_BIN_ENTRIES        3
+#define STAT_BIN_OVERFLOWS      4
+#define STAT_PIXELS_TESTED      5
+#define STAT_PIXELS_WRITTEN     6
+#define STAT_COUNT              7
+
+#define ADD_STAT(stats, index, amount) if ((stats) && (amount) > 0) atomic_add(&(stats)[index], (uint)(amount))
+
+// Triangles with a vertex closer to the camera than this are culled
+#ifndef NEAR_PLANE_Z
+#define NEAR_PLANE_Z 10.0f
+#endif
+
 // Packed vec3 structure matching the C++ vec struct (no padding)
 typedef struct __attribute__((packed)) {
     float x, y, z;
@@ -12,14 +48,13 @@ typedef struct global_data {
 } global_data_t;
 
 // Triangle metadata for binning pass
+// Vertices and texels live in the renderer's vertex / texture pools, triangles refer to them by offset
 typedef struct __attribute__((packed)) {
-    __global packed_vec3* vertexBuffer;  // Pointer to vertex buffer
-    int v0_idx, v1_idx, v2_idx;          // Vertex indices
+    int v0_idx, v1_idx, v2_idx;          // Vertex indices into the vertex pool
     float tex_coords[6];                 // 6 texture coordinates (u0,v0,u1,v1,u2,v2)
-    __global int* texture;               // Texture buffer (null for solid color triangles)
+    int tex_offset;                      // First texel in the texture pool (-1 for solid color triangles)
     int tex_width, tex_height;           // Texture dimensions
-    int color;                           // Solid color (used when texture is null)
-    int triangle_id;                     // Unique triangle ID for this frame
+    int color;                           // Solid color (used when there's no texture)
 } TriangleData;
 
 __kernel void makeGlobalData(__global float* depthBuffer,
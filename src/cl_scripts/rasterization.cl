@@ -217,12 +217,12 @@ __kernel void drawIndexed(__global float* depthBuffer, __global int* colorArray,
     float z1 = v0.z, z2 = v1.z, z3 = v2.z;
     
     // Cull triangles too close to camera
-    if(z1 < 10 || z2 < 10 || z3 < 10) {
+    if(z1 < NEAR_PLANE_Z || z2 < NEAR_PLANE_Z || z3 < NEAR_PLANE_Z) {
         return;
     }
     
     // Project to screen space
-    float scr_z = 1000.0f; // Same as used in CPU version
+    float scr_z = LEGACY_SCR_Z;
     float x1 = v0.x * scr_z / fabs(z1);
     float y1 = -v0.y * scr_z / fabs(z1);
     float x2 = v1.x * scr_z / fabs(z2);
@@ -351,12 +351,12 @@ __kernel void drawTexturedIndexed(__global float* depthBuffer, __global int* col
     float z1 = v0.z, z2 = v1.z, z3 = v2.z;
     
     // Cull triangles too close to camera
-    if(z1 < 10 || z2 < 10 || z3 < 10) {
+    if(z1 < NEAR_PLANE_Z || z2 < NEAR_PLANE_Z || z3 < NEAR_PLANE_Z) {
         return;
     }
     
     // Project to screen space
-    float scr_z = 1000.0f; // Same as used in CPU version
+    float scr_z = LEGACY_SCR_Z;
     float x1 = v0.x * scr_z / fabs(z1);
     float y1 = -v0.y * scr_z / fabs(z1);
     float x2 = v1.x * scr_z / fabs(z2);
@@ -0,0 +1,66 @@
+// Device-side geometry stage for meshes.
+// A mesh's world-space vertices are transformed into the frame's vertex pool and its triangles are
+// copied into the frame's triangle list, so static geometry never goes through the host again.
+// Instanced meshes are expanded here as well: instance i of a mesh with N vertices owns the
+// vertices [base + i*N, base + (i+1)*N) of the pool.
+
+// Placement of one mesh instance (matches Transform in util.hpp)
+typedef struct {
+    float4 row0, row1, row2;
+} InstanceTransform;
+
+// Transforms mesh vertices into camera space with the 3x4 view matrix (rows with translation in w).
+// With first_instance >= 0 every instance's model matrix is applied before the view matrix.
+__kernel void transformVertices(__global packed_vec3* vertices,
+                                int vertex_count,
+                                __global InstanceTransform* instances,
+                                int first_instance,
+                                int instance_count,
+                                __global packed_vec3* vertex_pool,
+                                int pool_offset,
+                                float4 view_row0, float4 view_row1, float4 view_row2) {
+    int i = get_global_id(0);
+    if (i >= vertex_count * instance_count) return;
+    
+    packed_vec3 v = vertices[i % vertex_count];
+    
+    if (first_instance >= 0) {
+        __global InstanceTransform* model = &instances[first_instance + i / vertex_count];
+        packed_vec3 world;
+        world.x = model->row0.x * v.x + model->row0.y * v.y + model->row0.z * v.z + model->row0.w;
+        world.y = model->row1.x * v.x + model->row1.y * v.y + model->row1.z * v.z + model->row1.w;
+        world.z = model->row2.x * v.x + model->row2.y * v.y + model->row2.z * v.z + model->row2.w;
+        v = world;
+    }
+    
+    packed_vec3 result;
+    result.x = view_row0.x * v.x + view_row0.y * v.y + view_row0.z * v.z + view_row0.w;
+    result.y = view_row1.x * v.x + view_row1.y * v.y + view_row1.z * v.z + view_row1.w;
+    result.z = view_row2.x * v.x + view_row2.y * v.y + view_row2.z * v.z + view_row2.w;
+    vertex_pool[pool_offset + i] = result;
+}
+
+// Appends a mesh's triangles to the frame's triangle list, once per instance.
+// Indices are rebased onto the instance's vertices in the vertex pool, textured triangles onto the
+// mesh's texture in the texture pool.
+__kernel void expandMeshTriangles(__global TriangleData* mesh_triangles,
+                                  int mesh_triangle_count,
+                                  int mesh_vertex_count,
+                                  int instance_count,
+                                  __global TriangleData* triangles,
+                                  int first_triangle,
+                                  int vertex_base,
+                                  int tex_offset) {
+    int i = get_global_id(0);
+    if (i >= mesh_triangle_count * instance_count) return;
+    
+    TriangleData triangle = mesh_triangles[i % mesh_triangle_count];
+    int instance_base = vertex_base + (i / mesh_triangle_count) * mesh_vertex_count;
+    triangle.v0_idx += instance_base;
+    triangle.v1_idx += instance_base;
+    triangle.v2_idx += instance_base;
+    if (triangle.tex_offset >= 0) {
+        triangle.tex_offset = tex_offset;
+    }
+    triangles[first_triangle + i] = triangle;
+}
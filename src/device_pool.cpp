@@ -0,0 +1,136 @@
+#include "../include/device_pool.hpp"
+#include "../include/rendering.hpp"
+#include <bit>
+#include <mutex>
+
+namespace lr {
+
+struct DevicePool::State {
+    std::mutex mutex;
+    size_t slabBytes;
+    size_t maxBlock;   // Largest size class
+    size_t alignment;  // Sub-buffer origins must be multiples of this
+    std::vector<cl::Buffer> slabs;
+    size_t slabUsed = 0;  // Bytes carved from slabs.back()
+    std::vector<std::vector<cl::Buffer>> freeLists;  // Per size class
+    Stats stats;
+
+    ~State() {
+        // Every block holds the state, so all of them are back on the free lists
+        for (size_t i = 0; i < slabs.size(); i++) memory::released(MEM_POOL, slabBytes);
+    }
+
+    // Carves a new block from the current slab, or from a new one if it's full
+    cl::Buffer carve(size_t blockBytes) {
+        size_t offset = (slabUsed + alignment - 1) / alignment * alignment;
+        if (slabs.empty() || offset + blockBytes > slabBytes) {
+            cl_int err;
+            slabs.push_back(cl::Buffer(gpuContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), slabBytes, nullptr, &err));
+            if (err != CL_SUCCESS) {
+                LOG_FATAL("DevicePool: slab allocation failed with error: " + std::to_string(err));
+            }
+            memory::allocated(MEM_POOL, slabBytes);
+            stats.slabCount++;
+            stats.slabBytes += slabBytes;
+            offset = 0;
+        }
+
+        cl_buffer_region region = {offset, blockBytes};
+        cl_int err;
+        cl::Buffer block = slabs.back().createSubBuffer(CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("DevicePool: createSubBuffer failed with error: " + std::to_string(err));
+        }
+        slabUsed = offset + blockBytes;
+        return block;
+    }
+};
+
+namespace {
+    struct Block {
+        cl::Buffer buffer;
+        int sizeClass;  // -1 for a dedicated buffer
+        size_t bytes;
+        MemoryCategory category;
+    };
+}
+
+DevicePool::DevicePool(size_t slabBytes) : state(std::make_shared<State>()) {
+    cl::Device& device = getGPU().getDevice();
+    state->slabBytes = std::min<size_t>(std::bit_floor(std::max(slabBytes, MIN_BLOCK * 4)), device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>());
+    state->maxBlock = std::max(std::bit_floor(state->slabBytes / 4), MIN_BLOCK);
+    state->alignment = std::max<size_t>(device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8, 1);
+    state->freeLists.resize(std::bit_width(state->maxBlock / MIN_BLOCK));
+    LOG_DEBUG("Created DevicePool with " + std::to_string(state->slabBytes) + " byte slabs, blocks up to " + std::to_string(state->maxBlock) + " bytes");
+}
+
+PoolAllocation DevicePool::allocate(size_t bytes, MemoryCategory category) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    Block* block;
+    if (bytes > state->maxBlock) {
+        cl_int err;
+        cl::Buffer buffer(gpuContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), bytes, nullptr, &err);
+        if (err != CL_SUCCESS) {
+            LOG_FATAL("DevicePool: allocation of " + std::to_string(bytes) + " bytes failed with error: " + std::to_string(err));
+        }
+        block = new Block{buffer, -1, bytes, category};
+        state->stats.dedicatedBytes += bytes;
+        memory::allocated(category, bytes);
+    } else {
+        // Size class k holds blocks of MIN_BLOCK << k bytes
+        int sizeClass = bytes <= MIN_BLOCK ? 0 : std::bit_width((bytes - 1) / MIN_BLOCK);
+        size_t blockBytes = MIN_BLOCK << sizeClass;
+        std::vector<cl::Buffer>& freeList = state->freeLists[sizeClass];
+        if (freeList.empty()) {
+            block = new Block{state->carve(blockBytes), sizeClass, blockBytes, category};
+        } else {
+            block = new Block{std::move(freeList.back()), sizeClass, blockBytes, category};
+            freeList.pop_back();
+        }
+        state->stats.blocksInUse++;
+        state->stats.bytesInUse += blockBytes;
+        memory::suballocated(MEM_POOL, category, blockBytes);
+    }
+
+    // The owner keeps the state alive, so blocks can be returned after the pool is gone
+    std::shared_ptr<State> owner = state;
+    std::shared_ptr<const void> handle(block, [owner](const Block* block) {
+        std::lock_guard<std::mutex> lock(owner->mutex);
+        if (block->sizeClass < 0) {
+            owner->stats.dedicatedBytes -= block->bytes;
+            memory::released(block->category, block->bytes);
+        } else {
+            owner->freeLists[block->sizeClass].push_back(block->buffer);
+            owner->stats.blocksInUse--;
+            owner->stats.bytesInUse -= block->bytes;
+            memory::subreleased(MEM_POOL, block->category, block->bytes);
+        }
+        delete block;
+    });
+    return {block->buffer, handle};
+}
+
+PoolAllocation allocateFromPool(DevicePool& pool, size_t bytes, MemoryCategory category) {
+    return pool.allocate(bytes, category);
+}
+
+DevicePool::Stats DevicePool::stats() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->stats;
+}
+
+FrameArena::FrameArena(size_t bytes) : m_capacity(std::max<size_t>(bytes, 1)) {
+    m_buffer = cl::Buffer(gpuContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), m_capacity);
+    m_allocation = memory::track(MEM_FRAME, m_capacity);
+}
+
+void FrameArena::grow(size_t bytes) {
+    // Room for everything this frame allocated so far plus the new range
+    m_capacity = std::max(m_capacity * 2, m_used + bytes);
+    m_buffer = cl::Buffer(gpuContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), m_capacity);
+    m_allocation = memory::track(MEM_FRAME, m_capacity);
+    m_used = 0;
+    LOG_DEBUG("FrameArena grown to " + std::to_string(m_capacity) + " bytes");
+}
+
+} // namespace lr
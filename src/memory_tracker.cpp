@@ -0,0 +1,193 @@
+#include "../include/memory_tracker.hpp"
+#include "../include/log.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+namespace lr {
+    namespace memory {
+
+        namespace {
+            struct Tracker {
+                std::mutex mutex;
+                CategoryStats categories[MEM_CATEGORY_COUNT];
+                size_t current = 0;
+                size_t peak = 0;
+                size_t device = 0;
+                double warningFraction = 0.9;
+                bool warned = false;  // Above the threshold since the last warning
+
+                Tracker() {
+                    if (const char* value = std::getenv("LR_MEMORY_WARN")) {
+                        double fraction = std::atof(value);
+                        if (fraction > 0) warningFraction = fraction;
+                    }
+                }
+
+                void add(MemoryCategory category, size_t bytes) {
+                    CategoryStats& stats = categories[category];
+                    stats.currentBytes += bytes;
+                    stats.peakBytes = std::max(stats.peakBytes, stats.currentBytes);
+                }
+
+                void remove(MemoryCategory category, size_t bytes) {
+                    CategoryStats& stats = categories[category];
+                    stats.currentBytes -= std::min(bytes, stats.currentBytes);
+                }
+
+                void count(MemoryCategory category) {
+                    categories[category].liveAllocations++;
+                    categories[category].totalAllocations++;
+                }
+
+                void uncount(MemoryCategory category) {
+                    if (categories[category].liveAllocations > 0) categories[category].liveAllocations--;
+                }
+
+                void checkThreshold() {
+                    size_t threshold = (size_t)(device * warningFraction);
+                    if (device == 0 || current <= threshold) {
+                        warned = false;
+                        return;
+                    }
+                    if (warned) return;
+                    warned = true;
+                    LOG_ERR("Device memory use " + std::to_string(current >> 20) + " MiB is above " + std::to_string((int)(warningFraction * 100)) +
+                            "% of the device's " + std::to_string(device >> 20) + " MiB\n" + format());
+                }
+
+                std::string format() {
+                    std::string result;
+                    char line[160];
+                    for (int i = 0; i < MEM_CATEGORY_COUNT; i++) {
+                        const CategoryStats& stats = categories[i];
+                        std::snprintf(line, sizeof(line), "%-14s %10.2f MiB (peak %10.2f MiB) %8zu live %10llu total allocations\n",
+                                      categoryName((MemoryCategory)i), stats.currentBytes / 1048576.0, stats.peakBytes / 1048576.0,
+                                      stats.liveAllocations, (unsigned long long)stats.totalAllocations);
+                        result += line;
+                    }
+                    std::snprintf(line, sizeof(line), "%-14s %10.2f MiB (peak %10.2f MiB)", "total", current / 1048576.0, peak / 1048576.0);
+                    result += line;
+                    if (device > 0) {
+                        std::snprintf(line, sizeof(line), " of %.0f MiB", device / 1048576.0);
+                        result += line;
+                    }
+                    return result;
+                }
+            };
+
+            // Never destroyed - buffers in static storage can be released after it would be
+            Tracker& tracker() {
+                static Tracker* instance = new Tracker();
+                return *instance;
+            }
+        }
+
+        const char* categoryName(MemoryCategory category) {
+            switch (category) {
+                case MEM_BUFFER: return "buffer";
+                case MEM_MESH: return "mesh";
+                case MEM_TEXTURE: return "texture";
+                case MEM_FRAME: return "frame";
+                case MEM_BINNING: return "binning";
+                case MEM_RENDER_TARGET: return "render target";
+                case MEM_POOL: return "pool (free)";
+                default: return "unknown";
+            }
+        }
+
+        std::shared_ptr<const void> track(MemoryCategory category, size_t bytes) {
+            allocated(category, bytes);
+            // The handle owns nothing - its deleter is the release
+            return std::shared_ptr<const void>(nullptr, [category, bytes](const void*) { released(category, bytes); });
+        }
+
+        void allocated(MemoryCategory category, size_t bytes) {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            t.add(category, bytes);
+            t.count(category);
+            t.current += bytes;
+            t.peak = std::max(t.peak, t.current);
+            t.checkThreshold();
+        }
+
+        void released(MemoryCategory category, size_t bytes) {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            t.remove(category, bytes);
+            t.uncount(category);
+            t.current -= std::min(bytes, t.current);
+            t.checkThreshold();
+        }
+
+        void suballocated(MemoryCategory parent, MemoryCategory category, size_t bytes) {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            t.remove(parent, bytes);
+            t.add(category, bytes);
+            t.count(category);
+        }
+
+        void subreleased(MemoryCategory parent, MemoryCategory category, size_t bytes) {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            t.remove(category, bytes);
+            t.uncount(category);
+            t.add(parent, bytes);
+        }
+
+        CategoryStats stats(MemoryCategory category) {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            return t.categories[category];
+        }
+
+        size_t currentBytes() {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            return t.current;
+        }
+
+        size_t peakBytes() {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            return t.peak;
+        }
+
+        void resetPeaks() {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            for (CategoryStats& stats : t.categories) stats.peakBytes = stats.currentBytes;
+            t.peak = t.current;
+        }
+
+        void setDeviceMemory(size_t bytes) {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            t.device = bytes;
+            t.checkThreshold();
+        }
+
+        size_t deviceMemory() {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            return t.device;
+        }
+
+        void setWarningThreshold(double fraction) {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            t.warningFraction = fraction;
+            t.warned = false;
+            t.checkThreshold();
+        }
+
+        std::string report() {
+            Tracker& t = tracker();
+            std::lock_guard<std::mutex> lock(t.mutex);
+            return t.format();
+        }
+    }
+} // namespace lr
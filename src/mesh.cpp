@@ -0,0 +1,60 @@
+#include "../include/mesh.hpp"
+#include "../include/log.hpp"
+
+std::vector<MeshTriangle> Mesh::buildTriangles(size_t vertexCount, std::span<const int> indices, std::span<const int> colors,
+                                               std::span<const TexCoord> texCoords, const std::optional<Texture>& texture) {
+    if (vertexCount == 0) {
+        LOG_FATAL("Mesh: no vertices");
+    }
+    if (indices.empty() || indices.size() % 3 != 0) {
+        LOG_FATAL("Mesh: index count must be a non-zero multiple of 3");
+    }
+    size_t count = indices.size() / 3;
+    if (colors.size() != count) {
+        LOG_FATAL("Mesh: expected one color per triangle");
+    }
+    if (!texCoords.empty() && texCoords.size() != vertexCount) {
+        LOG_FATAL("Mesh: expected one texture coordinate per vertex");
+    }
+    for (int index : indices) {
+        if (index < 0 || (size_t)index >= vertexCount) {
+            LOG_FATAL("Mesh: vertex index out of range");
+        }
+    }
+
+    std::vector<MeshTriangle> triangles(count);
+    for (size_t i = 0; i < count; i++) {
+        MeshTriangle& triangle = triangles[i];
+        triangle.v0_idx = indices[i * 3 + 0];
+        triangle.v1_idx = indices[i * 3 + 1];
+        triangle.v2_idx = indices[i * 3 + 2];
+        triangle.color = colors[i];
+        triangle.tex_offset = -1;  // No texture
+
+        if (texture.has_value()) {
+            // Same defaults as drawTexturedShape when no texture coordinates are given
+            TexCoord tc0(0.0f, 0.0f), tc1(1.0f, 0.0f), tc2(0.5f, 1.0f);
+            if (!texCoords.empty()) {
+                tc0 = texCoords[triangle.v0_idx];
+                tc1 = texCoords[triangle.v1_idx];
+                tc2 = texCoords[triangle.v2_idx];
+            }
+            triangle.tex_coords[0] = tc0.u; triangle.tex_coords[1] = tc0.v;
+            triangle.tex_coords[2] = tc1.u; triangle.tex_coords[3] = tc1.v;
+            triangle.tex_coords[4] = tc2.u; triangle.tex_coords[5] = tc2.v;
+            triangle.tex_offset = 0;
+            triangle.tex_width = texture->getWidth();
+            triangle.tex_height = texture->getHeight();
+        }
+    }
+    return triangles;
+}
+
+Mesh::Mesh(std::span<const vec> vertices, std::span<const int> indices, std::span<const int> colors,
+           std::span<const TexCoord> texCoords, std::optional<Texture> texture)
+    : vertexCount(vertices.size()), triangleCount(indices.size() / 3),
+      triangleBuffer(indices.size() / 3, gpuDevicePool(), buildTriangles(vertices.size(), indices, colors, texCoords, texture), lr::MEM_MESH),
+      vertexBuffer(vertices.size(), gpuDevicePool(), vertices, lr::MEM_MESH),
+      texture(std::move(texture)) {
+    LOG_DEBUG("Created mesh with " + std::to_string(vertexCount) + " vertices and " + std::to_string(triangleCount) + " triangles");
+}
@@ -0,0 +1,187 @@
+#include "../include/program_cache.hpp"
+#include "../include/log.hpp"
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+
+namespace {
+
+// FNV-1a for the entry's file name. Entries also store the full key, so a collision is a miss.
+uint64_t hashString(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+ProgramCache::ProgramCache(const cl::Context& context, const cl::Device& device, std::string directory)
+    : context(context), device(device), directory(std::move(directory)) {
+    if (this->directory.empty()) {
+        LOG_DEBUG("Program cache disabled");
+        return;
+    }
+    std::error_code err;
+    std::filesystem::create_directories(this->directory, err);
+    if (err) {
+        LOG_ERR("Can't create program cache directory " + this->directory + ": " + err.message() + " - caching disabled");
+        this->directory.clear();
+    }
+}
+
+std::string ProgramCache::defaultDirectory() {
+    if (const char* dir = std::getenv("LR_KERNEL_CACHE_DIR")) return dir;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) return std::string(xdg) + "/lr_kernels";
+    if (const char* home = std::getenv("HOME")) return std::string(home) + "/.cache/lr_kernels";
+    return "";
+}
+
+std::string ProgramCache::temporaryPath(const std::string& path) {
+    // Seeded once per process, so concurrent runs (and threads, with the counter) never pick the same name
+    static const uint64_t processTag = [] {
+        std::random_device random;
+        return (uint64_t)random() << 32 | random();
+    }();
+    static std::atomic<uint64_t> counter{0};
+    std::ostringstream name;
+    name << path << ".tmp" << std::hex << processTag << "-" << counter++;
+    return name.str();
+}
+
+std::string ProgramCache::cacheKey(const std::string& content, const std::string& options) const {
+    return device.getInfo<CL_DEVICE_NAME>() + '\n' +
+           device.getInfo<CL_DRIVER_VERSION>() + '\n' +
+           device.getInfo<CL_DEVICE_VERSION>() + '\n' +
+           options + '\n' + content;
+}
+
+std::string ProgramCache::entryPath(const std::string& key) const {
+    std::ostringstream path;
+    path << directory << "/" << std::hex << std::setw(16) << std::setfill('0') << hashString(key) << ".bin";
+    return path.str();
+}
+
+// An entry is "<key length>\n<key><binary>"
+bool ProgramCache::loadBinary(const std::string& path, const std::string& key, const std::string& options, cl::Program& program) const {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    size_t keyLength = 0;
+    if (!(file >> keyLength) || file.get() != '\n' || keyLength != key.size()) {
+        LOG_DEBUG("Cached program binary " + path + " belongs to another key");
+        return false;
+    }
+    std::string storedKey(keyLength, '\0');
+    if (!file.read(storedKey.data(), keyLength) || storedKey != key) {
+        LOG_DEBUG("Cached program binary " + path + " belongs to another key");
+        return false;
+    }
+    std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return false;
+
+    std::vector<cl_int> binaryStatus;
+    cl_int err = CL_SUCCESS;
+    program = cl::Program(context, {device}, cl::Program::Binaries{binary}, &binaryStatus, &err);
+    if (err != CL_SUCCESS || binaryStatus.empty() || binaryStatus[0] != CL_SUCCESS) {
+        LOG_DEBUG("Cached program binary " + path + " rejected by the driver");
+        return false;
+    }
+    // A program created from a binary still has to be built (linked) for the device
+    if (program.build({device}, options.c_str()) != CL_SUCCESS) {
+        LOG_DEBUG("Cached program binary " + path + " failed to build");
+        return false;
+    }
+    return true;
+}
+
+void ProgramCache::storeBinary(const std::string& path, const std::string& key, const cl::Program& program) const {
+    std::vector<std::vector<unsigned char>> binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+    if (binaries.empty() || binaries[0].empty()) {
+        LOG_DEBUG("Device returned no program binary - nothing cached");
+        return;
+    }
+
+    // Write to a temporary file first, so concurrent runs never see a partial binary
+    std::string tmpPath = temporaryPath(path);
+    {
+        std::ofstream file(tmpPath, std::ios::binary);
+        file << key.size() << '\n';
+        file.write(key.data(), key.size());
+        file.write(reinterpret_cast<const char*>(binaries[0].data()), binaries[0].size());
+        if (!file) {
+            LOG_ERR("Failed to write program cache entry " + tmpPath);
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    std::error_code err;
+    std::filesystem::rename(tmpPath, path, err);
+    if (err) {
+        LOG_ERR("Failed to store program cache entry " + path + ": " + err.message());
+        std::remove(tmpPath.c_str());
+    }
+}
+
+cl::Program ProgramCache::build(const std::string& source, const std::string& options) {
+    std::string key, path;
+    if (!directory.empty()) {
+        key = cacheKey(source, options);
+        path = entryPath(key);
+        cl::Program cached;
+        if (loadBinary(path, key, options, cached)) {
+            LOG_DEBUG("Loaded program from cache: " + path);
+            return cached;
+        }
+    }
+
+    cl::Program program(context, cl::Program::Sources{source});
+    if (program.build({device}, options.c_str()) != CL_SUCCESS) {
+        LOG_ERR(program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
+        LOG_FATAL("OpenCL program build failed (options: " + options + ")");
+    }
+
+    if (!path.empty()) {
+        storeBinary(path, key, program);
+        LOG_DEBUG("Stored program in cache: " + path);
+    }
+    return program;
+}
+
+std::optional<cl::Program> ProgramCache::buildIL(const std::vector<char>& il, const std::string& options) {
+    std::string key, path;
+    if (!directory.empty()) {
+        // Prefixed so an IL entry never collides with a source entry built with the same options
+        key = cacheKey(std::string(il.begin(), il.end()), "IL " + options);
+        path = entryPath(key);
+        cl::Program cached;
+        if (loadBinary(path, key, options, cached)) {
+            LOG_DEBUG("Loaded IL program from cache: " + path);
+            return cached;
+        }
+    }
+
+    cl_int err = CL_SUCCESS;
+    cl::Program program(context, il, false, &err);
+    if (err != CL_SUCCESS) {
+        LOG_DEBUG("Device rejected the IL module (error " + std::to_string(err) + ")");
+        return std::nullopt;
+    }
+    if (program.build({device}, options.c_str()) != CL_SUCCESS) {
+        LOG_ERR(program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
+        LOG_ERR("OpenCL IL program build failed (options: " + options + ")");
+        return std::nullopt;
+    }
+
+    if (!path.empty()) {
+        storeBinary(path, key, program);
+        LOG_DEBUG("Stored IL program in cache: " + path);
+    }
+    return program;
+}
@@ -0,0 +1,182 @@
+#include "../include/render_target.hpp"
+#include "../include/log.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool initialized = false;
+    if (!initialized) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        initialized = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+void writeChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    appendBigEndian(chunk, (uint32_t)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    appendBigEndian(chunk, crc32(chunk.data() + 4, data.size() + 4));
+    file.write((const char*)chunk.data(), chunk.size());
+}
+
+bool writePpm(std::ofstream& file, const uint32_t* pixels, int width, int height) {
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<uint8_t> row(width * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint32_t color = pixels[y * width + x];
+            row[x * 3] = color >> 16;
+            row[x * 3 + 1] = color >> 8;
+            row[x * 3 + 2] = color;
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return (bool)file;
+}
+
+// RGB PNG with the image data in stored (uncompressed) deflate blocks - no zlib needed
+bool writePng(std::ofstream& file, const uint32_t* pixels, int width, int height) {
+    const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write((const char*)signature, sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});  // 8 bits per channel, RGB, no interlacing
+    writeChunk(file, "IHDR", header);
+
+    // Every row starts with filter type 0
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t)height * (width * 3 + 1));
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        for (int x = 0; x < width; x++) {
+            uint32_t color = pixels[y * width + x];
+            raw.push_back(color >> 16);
+            raw.push_back(color >> 8);
+            raw.push_back(color);
+        }
+    }
+
+    const size_t MAX_BLOCK = 65535;
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    zlib.reserve(raw.size() + raw.size() / MAX_BLOCK * 5 + 16);
+    uint32_t a = 1, b = 0;  // Adler-32
+    for (size_t offset = 0; offset < raw.size() || offset == 0; offset += MAX_BLOCK) {
+        size_t size = std::min(MAX_BLOCK, raw.size() - offset);
+        bool last = offset + size >= raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(size & 0xFF);
+        zlib.push_back(size >> 8);
+        zlib.push_back(~size & 0xFF);
+        zlib.push_back((~size >> 8) & 0xFF);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        for (size_t i = offset; i < offset + size; i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        if (last) break;
+    }
+    appendBigEndian(zlib, (b << 16) | a);
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+    return (bool)file;
+}
+
+bool hasPngExtension(const std::string& path) {
+    return path.size() >= 4 && (path.compare(path.size() - 4, 4, ".png") == 0 || path.compare(path.size() - 4, 4, ".PNG") == 0);
+}
+
+}
+
+bool writeImage(const std::string& path, const uint32_t* pixels, int width, int height, ImageFormat format) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        LOG_ERR("Can't write image " + path);
+        return false;
+    }
+    bool written = format == IMAGE_PNG ? writePng(file, pixels, width, height) : writePpm(file, pixels, width, height);
+    if (!written) LOG_ERR("Failed to write image " + path);
+    return written;
+}
+
+bool writeImage(const std::string& path, const uint32_t* pixels, int width, int height) {
+    return writeImage(path, pixels, width, height, hasPngExtension(path) ? IMAGE_PNG : IMAGE_PPM);
+}
+
+MemoryRenderTarget::MemoryRenderTarget(uint32_t* destination, int pitch)
+    : destination(destination), pitch(pitch) {}
+
+void MemoryRenderTarget::present(const uint32_t* pixels, int width, int height, uint64_t) {
+    if (pitch == width) {
+        std::memcpy(destination, pixels, sizeof(uint32_t) * width * height);
+        return;
+    }
+    for (int y = 0; y < height; y++) {
+        std::memcpy(destination + (size_t)y * pitch, pixels + (size_t)y * width, sizeof(uint32_t) * width);
+    }
+}
+
+ImageFileTarget::ImageFileTarget(const std::string& pattern)
+    : ImageFileTarget(pattern, hasPngExtension(pattern) ? IMAGE_PNG : IMAGE_PPM) {}
+
+// The pattern isn't passed to printf - the frame number is put in here, so no pattern
+// can make a format string read arguments that aren't there
+ImageFileTarget::ImageFileTarget(const std::string& pattern, ImageFormat format)
+    : format(format) {
+    for (size_t i = 0; i < pattern.size(); i++) {
+        std::string& out = numbered ? suffix : prefix;
+        if (pattern[i] != '%') {
+            out += pattern[i];
+            continue;
+        }
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+            out += '%';
+            i++;
+            continue;
+        }
+        // %d or %0Nd
+        size_t end = i + 1;
+        bool zeroPadded = end < pattern.size() && pattern[end] == '0';
+        int minDigits = 0;
+        while (end < pattern.size() && std::isdigit((unsigned char)pattern[end]) && minDigits < 100) minDigits = minDigits * 10 + (pattern[end++] - '0');
+        if (numbered || end >= pattern.size() || pattern[end] != 'd' || (minDigits > 0 && !zeroPadded) || minDigits > 20) {
+            LOG_FATAL("ImageFileTarget: path pattern " + pattern + " must have at most one %d or %0Nd conversion");
+        }
+        numbered = true;
+        digits = minDigits;
+        i = end;
+    }
+}
+
+void ImageFileTarget::present(const uint32_t* pixels, int width, int height, uint64_t frame) {
+    std::string path = prefix;
+    if (numbered) {
+        std::string number = std::to_string(frame);
+        if ((int)number.size() < digits) path.append(digits - number.size(), '0');
+        path += number + suffix;
+    }
+    writeImage(path, pixels, width, height, format);
+}
@@ -1,6 +1,5 @@
 #define CL_HPP_TARGET_OPENCL_VERSION 300
 #include <CL/opencl.hpp>
-#include <SDL2/SDL.h>
 #include <iostream>
 #include <vector>
 #include <memory>
@@ -10,10 +9,31 @@
 #include <cassert>
 #include <optional>
 #include <cstddef>
+#include <cstdlib>
+#include <climits>
+#include <unordered_map>
+#include <deque>
+#include <map>
+#include <array>
+#include <iomanip>
+#include <bit>
 #include "../include/rendering.hpp"
 #include "../include/texture.hpp" // For Texture and TexCoord definitions
 #include "../include/util.hpp"
+#include "../include/mesh.hpp"
+#include "../include/program_cache.hpp"
+#include "../include/autotune.hpp"
+#include "../include/trace.hpp"
+#include "../include/render_target.hpp"
 #include "../include/buffer.hpp" // ensure prototypes match
+#include "../include/device_pool.hpp"
+#include "../include/memory_tracker.hpp"
+#ifdef LR_EMBEDDED_KERNELS
+#include "lr_kernels.hpp"
+#endif
+#ifdef LR_EMBEDDED_SPIRV
+#include "lr_kernels_spirv.hpp"
+#endif
 
 // Helper functions for buffer.hpp
 cl::Context& gpuContext() {
@@ -24,6 +44,47 @@ cl::CommandQueue& gpuQueue() {
     return getGPU().getQueue();
 }
 
+cl_mem_flags gpuAllocFlags() {
+    return getGPU().isCPU() ? CL_MEM_ALLOC_HOST_PTR : 0;
+}
+
+// Created on first use, so programs that never touch the pool don't reserve a slab
+static std::unique_ptr<lr::DevicePool> devicePool;
+
+lr::DevicePool& gpuDevicePool() {
+    if (!devicePool) devicePool = std::make_unique<lr::DevicePool>();
+    return *devicePool;
+}
+
+DeviceSelection DeviceSelection::fromEnvironment() {
+    DeviceSelection selection;
+    const char* profile = std::getenv("LR_PROFILE");
+    selection.profiling = (profile && std::string(profile) == "1") || std::getenv("LR_TRACE");  // Traces need device timestamps
+    const char* env = std::getenv("LR_DEVICE");
+    if (!env) return selection;
+    
+    std::string value(env);
+    int platformIndex, deviceIndex;
+    char separator;
+    std::istringstream indices(value);
+    if (value == "gpu") {
+        selection.preference = DEVICE_GPU_ONLY;
+    } else if (value == "prefer-gpu") {
+        selection.preference = DEVICE_PREFER_GPU;
+    } else if (value == "cpu") {
+        selection.preference = DEVICE_CPU_ONLY;
+    } else if (value == "most-cu") {
+        selection.preference = DEVICE_MOST_COMPUTE_UNITS;
+    } else if (indices >> platformIndex >> separator >> deviceIndex && separator == ':') {
+        selection.preference = DEVICE_BY_INDEX;
+        selection.platformIndex = platformIndex;
+        selection.deviceIndex = deviceIndex;
+    } else {
+        LOG_ERR("Unknown LR_DEVICE value '" + value + "' - using the default device selection");
+    }
+    return selection;
+}
+
 class _GPU {
     friend class GPU; // Allow facade to access private members
     private:
@@ -33,43 +94,102 @@ class _GPU {
         cl::CommandQueue queue;
         cl::Device device;
 
+    public:
+        bool cpu = false;
+        bool profiling = false;
+        bool unifiedMemory = false;  // CPU device or integrated GPU sharing memory with the host
+        
+        static bool isDeviceType(const cl::Device& device, cl_device_type type) {
+            return (device.getInfo<CL_DEVICE_TYPE>() & type) != 0;
+        }
+        
+        // Returns the (platform, device) pair the policy asks for, nullopt if there's none
+        static std::optional<std::pair<cl::Platform, cl::Device>> selectDevice(const std::vector<cl::Platform>& platforms, const DeviceSelection& selection) {
+            if (selection.preference == DEVICE_BY_INDEX) {
+                if (selection.platformIndex < 0 || selection.platformIndex >= (int)platforms.size()) return std::nullopt;
+                std::vector<cl::Device> devices;
+                platforms[selection.platformIndex].getDevices(CL_DEVICE_TYPE_ALL, &devices);
+                if (selection.deviceIndex < 0 || selection.deviceIndex >= (int)devices.size()) return std::nullopt;
+                return std::make_pair(platforms[selection.platformIndex], devices[selection.deviceIndex]);
+            }
+            
+            std::optional<std::pair<cl::Platform, cl::Device>> firstGPU, firstCPU, firstAny, mostComputeUnits;
+            cl_uint maxComputeUnits = 0;
+            for (const cl::Platform& platform : platforms) {
+                std::vector<cl::Device> devices;
+                platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+                for (const cl::Device& device : devices) {
+                    if (!firstAny) firstAny = std::make_pair(platform, device);
+                    if (!firstGPU && isDeviceType(device, CL_DEVICE_TYPE_GPU)) firstGPU = std::make_pair(platform, device);
+                    if (!firstCPU && isDeviceType(device, CL_DEVICE_TYPE_CPU)) firstCPU = std::make_pair(platform, device);
+                    cl_uint computeUnits = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+                    if (computeUnits > maxComputeUnits) {
+                        maxComputeUnits = computeUnits;
+                        mostComputeUnits = std::make_pair(platform, device);
+                    }
+                }
+            }
+            
+            switch (selection.preference) {
+                case DEVICE_GPU_ONLY: return firstGPU;
+                case DEVICE_CPU_ONLY: return firstCPU;
+                case DEVICE_MOST_COMPUTE_UNITS: return mostComputeUnits;
+                default: return firstGPU ? firstGPU : firstAny;
+            }
+        }
+
     public:
         bool isInitialized(){
             return initialized;
         }
-        _GPU(){
-            std::vector<cl::Platform> platforms;
-            cl::Platform::get(&platforms);
-            for (auto &p : platforms) {
+        _GPU(const DeviceSelection& selection){
+            std::vector<cl::Platform> allPlatforms, platforms;
+            cl::Platform::get(&allPlatforms);
+            for (auto &p : allPlatforms) {
                 std::string platver = p.getInfo<CL_PLATFORM_VERSION>();
                 if (platver.find("OpenCL 2.") != std::string::npos ||
                     platver.find("OpenCL 3.") != std::string::npos) {
-                    plat = p;
-                    break; // Exit after finding the first matching platform
+                    platforms.push_back(p);
                 }
             }
             
-            if (plat() == nullptr) { 
+            if (platforms.empty()) { 
                 std::cerr << "No OpenCL 2.0 or newer platform found.\n";
                 throw std::runtime_error("No OpenCL 2.0 or newer platform found.");
             }
-            std::vector<cl::Device> devices;
-            plat.getDevices(CL_DEVICE_TYPE_GPU, &devices); // Prefer GPU devices
-            if (devices.empty()) {
-                std::cerr << "No GPU device found.\n";
-                throw std::runtime_error("No GPU device found.");
+            
+            auto selected = selectDevice(platforms, selection);
+            if (!selected) {
+                std::cerr << "No OpenCL device matches the device selection.\n";
+                throw std::runtime_error("No OpenCL device matches the device selection.");
             }
-
-            device = devices.front(); // Use the first available device
+            plat = selected->first;
+            device = selected->second;
+            cpu = isDeviceType(device, CL_DEVICE_TYPE_CPU);
+            unifiedMemory = cpu || device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>();
+            
             std::string deviceName;
             device.getInfo(CL_DEVICE_NAME, &deviceName);
+            LOG_INFO("Using OpenCL device: " + deviceName + (cpu ? " (CPU)" : "") + " on " + plat.getInfo<CL_PLATFORM_NAME>());
+            lr::memory::setDeviceMemory(device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>());
 
             // Create a context and command queue
             context = cl::Context(device);
-            queue = cl::CommandQueue(context, device);
+            profiling = selection.profiling;
+            queue = cl::CommandQueue(context, device, profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
+            if (profiling) LOG_INFO("OpenCL profiling enabled");
 
             initialized = true;
         }
+        bool isCPU(){
+            return cpu;
+        }
+        bool isProfiling(){
+            return profiling;
+        }
+        bool hasUnifiedMemory(){
+            return unifiedMemory;
+        }
         cl::Device& getDevice(){
             return device;
         }
@@ -89,8 +209,8 @@ class _GPU {
 GPU* gpu;
 
 
-GPU::GPU(){
-    pimpl = new _GPU();
+GPU::GPU(const DeviceSelection& selection){
+    pimpl = new _GPU(selection);
 }
 GPU::~GPU(){
     delete pimpl;
@@ -98,6 +218,15 @@ GPU::~GPU(){
 bool GPU::isInitialized(){
     return pimpl->isInitialized();
 }
+bool GPU::isCPU(){
+    return pimpl->isCPU();
+}
+bool GPU::isProfiling(){
+    return pimpl->isProfiling();
+}
+bool GPU::hasUnifiedMemory(){
+    return pimpl->hasUnifiedMemory();
+}
 cl::Device& GPU::getDevice(){
     return pimpl->getDevice();
 }
@@ -114,7 +243,12 @@ cl::Context& GPU::getContext(){
 
 
 void initGPU(){
-    gpu = new GPU();
+    if (const char* tracePath = std::getenv("LR_TRACE")) lr::trace::start(tracePath);
+    initGPU(DeviceSelection::fromEnvironment());
+}
+
+void initGPU(const DeviceSelection& selection){
+    gpu = new GPU(selection);
 }
 
 GPU& getGPU(){
@@ -122,282 +256,877 @@ GPU& getGPU(){
 }
 
 void deleteGPU(){
+    devicePool.reset();
     delete gpu;
 }
 
-// Triangle metadata structure for CPU-side processing
-struct TriangleMetadata {
-    cl::Buffer* vertexBuffer;  // Pointer to vertex buffer
-    int v0_idx, v1_idx, v2_idx;          // Vertex indices
-    float tex_coords[6];                 // 6 texture coordinates (u0,v0,u1,v1,u2,v2)
-    cl::Buffer* texture;                 // Texture buffer (null for solid color triangles)
-    int tex_width, tex_height;           // Texture dimensions
-    int color;                           // Solid color (used when texture is null)
-    int triangle_id;                     // Unique triangle ID for this frame
-};
-
 // GPU-compatible triangle data structure (matches OpenCL TriangleData)
+// Geometry and textures are referenced by offsets into the renderer's pools,
+// so the record holds no device handles.
 #pragma pack(push, 1)
 struct GPUTriangleData {
-    cl_mem vertexBuffer;     // OpenCL buffer handle
     int v0_idx, v1_idx, v2_idx;
     float tex_coords[6];
-    cl_mem texture;          // OpenCL texture handle (0 for solid color)
+    int tex_offset;          // -1 for solid color
     int tex_width, tex_height;
     int color;
-    int triangle_id;
 };
 #pragma pack(pop)
 
 // Debug the actual sizes at compile time
-static_assert(sizeof(cl_mem) == 8, "cl_mem should be 8 bytes on 64-bit systems");
 static_assert(sizeof(int) == 4, "int should be 4 bytes");
 static_assert(sizeof(float) == 4, "float should be 4 bytes");
 
 // Compile-time verification that GPUTriangleData has the expected packed size
-// Actual layout: cl_mem (8) + 3*int (12) + 6*float (24) + cl_mem (8) + 2*int (8) = 60 bytes of data + 8 bytes padding = 68 bytes
-static_assert(sizeof(GPUTriangleData) == 68, "GPUTriangleData must be exactly 68 bytes to match OpenCL TriangleData");
+// Layout: 3*int (12) + 6*float (24) + 4*int (16) = 52 bytes
+static_assert(sizeof(GPUTriangleData) == 52, "GPUTriangleData must be exactly 52 bytes to match OpenCL TriangleData");
+static_assert(sizeof(MeshTriangle) == sizeof(GPUTriangleData), "MeshTriangle must have the TriangleData layout");
+
+// Device-side frame counters (matches STAT_* in common.cl)
+enum FrameStatCounter {
+    STAT_CULLED_NEAR,
+    STAT_CULLED_DEGENERATE,
+    STAT_CULLED_OFFSCREEN,
+    STAT_BIN_ENTRIES,
+    STAT_BIN_OVERFLOWS,
+    STAT_PIXELS_TESTED,
+    STAT_PIXELS_WRITTEN,
+    STAT_COUNT
+};
 
-// Constants matching the OpenCL binning.cl definitions
-const int TILE_SIZE = 32;  // Each tile is 32x32 pixels
-const int MAX_TRIANGLES_PER_TILE = 256;  // Maximum triangles that can be assigned to a tile
+// Parts of a frame that FrameTimings reports separately
+enum FrameStage {
+    STAGE_CLEAR,
+    STAGE_UPLOAD,
+    STAGE_TRANSFORM,
+    STAGE_BINNING,
+    STAGE_RENDER,
+    STAGE_READBACK,
+};
+
+// Collects a profiling event for every command of a frame and turns them into FrameTimings
+// (and trace events, while a trace is recorded) once the frame is done. Without a profiling
+// queue event() returns nullptr, so enqueues get no event and cost nothing extra.
+class FrameProfiler {
+public:
+    struct Command {
+        FrameStage stage;
+        const char* name;
+        cl::Event event;
+        uint64_t hostEnqueue;  // Trace clock, taken right before the enqueue
+    };
+    typedef std::deque<Command> FrameEvents;
+
+private:
+    static constexpr size_t WINDOW = 60;
+    bool enabled;
+    FrameEvents current;
+    std::deque<FrameTimings> history;
+    FrameTimings last, sum;
+    // Device clock to trace clock. A command can't be queued before the host enqueued it,
+    // so every command gives a lower bound and the largest one is the best estimate.
+    int64_t deviceToHost = INT64_MIN;
+
+    static const char* stageName(FrameStage stage) {
+        switch (stage) {
+            case STAGE_CLEAR: return "clear";
+            case STAGE_UPLOAD: return "upload";
+            case STAGE_TRANSFORM: return "transform";
+            case STAGE_BINNING: return "binning";
+            case STAGE_RENDER: return "render";
+            default: return "readback";
+        }
+    }
+
+    static uint64_t& stageTime(FrameTimings& timings, FrameStage stage) {
+        switch (stage) {
+            case STAGE_CLEAR: return timings.clear;
+            case STAGE_UPLOAD: return timings.upload;
+            case STAGE_TRANSFORM: return timings.transform;
+            case STAGE_BINNING: return timings.binning;
+            case STAGE_RENDER: return timings.render;
+            default: return timings.readback;
+        }
+    }
+
+public:
+    FrameProfiler() : enabled(getGPU().isProfiling()) {}
+    
+    bool isEnabled() const { return enabled; }
+
+    // Pass as the event argument of an enqueue. The pointer is only valid until the next call.
+    cl::Event* event(FrameStage stage, const char* name) {
+        if (!enabled) return nullptr;
+        current.push_back({stage, name, cl::Event(), lr::trace::now()});
+        return &current.back().event;
+    }
+    
+    // For commands whose event the renderer keeps anyway. hostEnqueue is lr::trace::now()
+    // taken before the enqueue - the clock estimate in resolve() needs a time that isn't later.
+    void record(FrameStage stage, const char* name, const cl::Event& event, uint64_t hostEnqueue) {
+        if (enabled) current.push_back({stage, name, event, hostEnqueue});
+    }
+
+    // Events of the frame so far - hand them back to resolve() once the frame is done
+    FrameEvents takeFrame() {
+        FrameEvents events;
+        events.swap(current);
+        return events;
+    }
+
+    void resolve(FrameEvents& events) {
+        if (!enabled) return;
+        FrameTimings timings;
+        bool tracing = lr::trace::isRecording();
+        for (Command& command : events) {
+            if (!command.event()) continue;  // The command was skipped (e.g. a pool source that was already copied)
+            cl_int startErr = CL_SUCCESS, endErr = CL_SUCCESS;
+            cl_ulong start = command.event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&startErr);
+            cl_ulong end = command.event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&endErr);
+            if (startErr != CL_SUCCESS || endErr != CL_SUCCESS) continue;
+            stageTime(timings, command.stage) += end - start;
+            
+            if (tracing) {
+                cl_ulong queued = command.event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(&startErr);
+                if (startErr == CL_SUCCESS) deviceToHost = std::max(deviceToHost, (int64_t)command.hostEnqueue - (int64_t)queued);
+                lr::trace::addDeviceEvent(command.name, stageName(command.stage), start + deviceToHost, end + deviceToHost);
+            }
+        }
+        events.clear();
+        
+        last = timings;
+        history.push_back(timings);
+        for (FrameStage stage : {STAGE_CLEAR, STAGE_UPLOAD, STAGE_TRANSFORM, STAGE_BINNING, STAGE_RENDER, STAGE_READBACK}) {
+            stageTime(sum, stage) += stageTime(timings, stage);
+            if (history.size() > WINDOW) stageTime(sum, stage) -= stageTime(history.front(), stage);
+        }
+        if (history.size() > WINDOW) history.pop_front();
+    }
+
+    FrameTimingReport report() const {
+        FrameTimingReport result;
+        result.last = last;
+        result.frameCount = (int)history.size();
+        if (!history.empty()) {
+            FrameTimings average = sum;
+            for (FrameStage stage : {STAGE_CLEAR, STAGE_UPLOAD, STAGE_TRANSFORM, STAGE_BINNING, STAGE_RENDER, STAGE_READBACK}) {
+                stageTime(average, stage) /= history.size();
+            }
+            result.average = average;
+        }
+        return result;
+    }
+};
+
+// Device array that other buffers get copied into, so kernels reach all of them
+// through a single cl_mem and plain element offsets.
+// Sources are looked up by their cl_mem and the offset of the copied range. The pool keeps
+// a cl::Buffer reference to every source it copied, so a handle can't be released and
+// reused by another buffer while it's still registered here - and the owner of sources
+// from a DevicePool, whose sub-buffer handles are recycled without being released.
+template<typename T>
+class BufferPool {
+private:
+    struct SourceKey {
+        cl_mem buffer;
+        size_t offset;
+        bool operator==(const SourceKey& other) const { return buffer == other.buffer && offset == other.offset; }
+    };
+    struct SourceKeyHash {
+        size_t operator()(const SourceKey& key) const {
+            return std::hash<cl_mem>()(key.buffer) ^ (std::hash<size_t>()(key.offset) * 0x9E3779B97F4A7C15ull);
+        }
+    };
+    // Copies wait for flushCopies(), so back-to-back ranges of one source (e.g. the
+    // allocations of a StreamingBuffer) go to the device as a single copy
+    struct PendingCopy {
+        cl::Buffer source;
+        size_t sourceOffset;
+        size_t offset;
+        size_t count;
+    };
+    struct Source {
+        cl::Buffer buffer;
+        std::shared_ptr<const void> owner;
+        int offset;
+        size_t count;
+        uint64_t lastUse;  // Frame of the newest acquire
+    };
+    
+    lr::DynamicBuffer<T> pool;
+    std::unordered_map<SourceKey, Source, SourceKeyHash> offsets;
+    std::vector<PendingCopy> pendingCopies;
+    FrameProfiler& profiler;
+    const char* copyName;  // Of the copies in traces
+    uint64_t frame = 0;
+
+public:
+    BufferPool(size_t initialCapacity, FrameProfiler& profiler, const char* copyName)
+        : pool(initialCapacity, lr::MEM_FRAME), profiler(profiler), copyName(copyName) {}
+    
+    // Offset in the pool of element sourceOffset of the source. The first call for a range
+    // queues a device-side copy of its count elements, issued by flushCopies() - or right away
+    // with immediate, for sources the caller may overwrite before then.
+    int acquire(const cl::Buffer& source, size_t count, size_t sourceOffset = 0, const std::shared_ptr<const void>& owner = nullptr,
+                bool immediate = false) {
+        auto it = offsets.find({source(), sourceOffset});
+        if (it != offsets.end()) {
+            it->second.lastUse = frame;
+            return it->second.offset;
+        }
+        
+        int offset = allocate(count);
+        offsets.emplace(SourceKey{source(), sourceOffset}, Source{source, owner, offset, count, frame});
+        if (immediate) {
+            assert(getGPU().getQueue().enqueueCopyBuffer(source, pool.getCLBuffer(), sizeof(T) * sourceOffset, sizeof(T) * offset, sizeof(T) * count, nullptr, profiler.event(STAGE_UPLOAD, copyName)) == CL_SUCCESS);
+            return offset;
+        }
+        if (!pendingCopies.empty()) {
+            PendingCopy& last = pendingCopies.back();
+            if (last.source() == source() && last.sourceOffset + last.count == sourceOffset && last.offset + last.count == (size_t)offset) {
+                last.count += count;
+                return offset;
+            }
+        }
+        pendingCopies.push_back({source, sourceOffset, (size_t)offset, count});
+        return offset;
+    }
+    
+    // Queues the copies of the ranges acquired since the last call
+    void flushCopies() {
+        for (const PendingCopy& copy : pendingCopies) {
+            assert(getGPU().getQueue().enqueueCopyBuffer(copy.source, pool.getCLBuffer(), sizeof(T) * copy.sourceOffset, sizeof(T) * copy.offset, sizeof(T) * copy.count, nullptr, profiler.event(STAGE_UPLOAD, copyName)) == CL_SUCCESS);
+        }
+        pendingCopies.clear();
+    }
+    
+    // Reserves count elements to be filled by a kernel. Bind getCLBuffer() only after
+    // this call - the pool can move to a bigger buffer.
+    int allocate(size_t count) {
+        size_t offset = pool.size();
+        pool.resize(offset + count);  // Growing keeps what was written so far
+        return (int)offset;
+    }
+    
+    // Starts a frame of a pool that keeps its sources across frames. Sources that no frame
+    // acquired in the last maxUnusedFrames frames are stale - once they take up more than half
+    // of the pool, it's reset. That releases the stale sources and their owners; the ones still
+    // in use are copied in again by their next acquire.
+    void startFrame(uint64_t maxUnusedFrames) {
+        frame++;
+        size_t live = 0;
+        for (const auto& [key, source] : offsets) {
+            if (frame - source.lastUse <= maxUnusedFrames) live += source.count;
+        }
+        if (pool.size() > 2 * live) {
+            LOG_DEBUG("BufferPool (" + std::string(copyName) + ") dropped " + std::to_string(pool.size() - live) + " stale elements");
+            reset();
+        }
+    }
+    
+    // Forget all sources and start filling the pool from the beginning
+    void reset() {
+        offsets.clear();
+        pendingCopies.clear();
+        pool.clear();
+    }
+    
+    const cl::Buffer& getCLBuffer() const { return pool.getCLBuffer(); }
+    size_t size() const { return pool.size(); }
+};
+
+// Output of the setupTriangles kernel (matches OpenCL TriangleSetup in binning.cl).
+// Only the device reads and writes it - the host needs the layout for sizing the buffer.
+struct GPUTriangleSetup {
+    float l1_dx, l1_dy, l1_c;
+    float l2_dx, l2_dy, l2_c;
+    float iz_dx, iz_dy, iz_c;
+    float u_dx, u_dy, u_c;
+    float v_dx, v_dy, v_c;
+    int min_x, min_y, max_x, max_y;
+    int state;
+    int color;
+    int tex_offset;
+    int tex_width, tex_height;
+};
+static_assert(sizeof(GPUTriangleSetup) == 96, "GPUTriangleSetup must be exactly 96 bytes to match OpenCL TriangleSetup");
+
+// Tile configuration, passed to the kernels with -D (binning.cl only has fallbacks)
+constexpr int DEFAULT_TILE_SIZE = 32;  // Each tile is 32x32 pixels
+constexpr int MAX_TRIANGLES_PER_TILE = 256;  // Maximum triangles that can be assigned to a tile
+
+// Values baked into a build of the kernels, so the device compiler can constant-fold
+// them and unroll the loops over the tile (see SPECIALIZE_* in common.cl and binning.cl)
+struct KernelVariant {
+    int tileSize;
+    int screenWidth, screenHeight;
+    float scrZ;
+    bool textured;  // false compiles renderTile without the texture path
+
+    std::string buildOptions() const {
+        std::ostringstream options;
+        options << "-cl-std=CL3.0"
+                << " -D TILE_SIZE=" << tileSize
+                << " -D MAX_TRIANGLES_PER_TILE=" << MAX_TRIANGLES_PER_TILE
+                << " -D SCREEN_WIDTH=" << screenWidth
+                << " -D SCREEN_HEIGHT=" << screenHeight
+                << " -D SCR_Z=" << std::showpoint << std::setprecision(9) << scrZ << "f";
+        if (!textured) options << " -D UNTEXTURED";
+        return options.str();
+    }
+};
+
+// Programs built so far, one per variant. A variant is compiled the first time it's
+// requested, and ProgramCache keeps the binary on disk for later runs.
+class KernelVariantCache {
+private:
+    ProgramCache programCache;
+    std::string source;
+    std::map<std::string, cl::Program> programs;  // By build options
+#ifdef LR_EMBEDDED_SPIRV
+    // -D values can't be applied to IL, so the offline module is generic: its kernels read
+    // every value from their arguments. It stands in for all variants with the default tile size.
+    std::optional<cl::Program> spirvProgram;
+#endif
+
+public:
+    explicit KernelVariantCache(std::string source)
+        : programCache(getGPU().getContext(), getGPU().getDevice()), source(std::move(source)) {
+#ifdef LR_EMBEDDED_SPIRV
+        // Prefer the offline-compiled SPIR-V module where the device takes IL
+        std::string ilVersion = getGPU().getDevice().getInfo<CL_DEVICE_IL_VERSION>();
+        if (ilVersion.find("SPIR-V") != std::string::npos) {
+            std::vector<char> il(std::begin(lr_kernels_spirv), std::end(lr_kernels_spirv));
+            spirvProgram = programCache.buildIL(il, "");
+            if (spirvProgram) LOG_DEBUG("Using SPIR-V kernels");
+            else LOG_INFO("SPIR-V kernels unusable on this device - compiling from source");
+        }
+#endif
+    }
+
+    cl::Program& get(const KernelVariant& variant) {
+        std::string options = variant.buildOptions();
+        auto it = programs.find(options);
+        if (it != programs.end()) return it->second;
+
+#ifdef LR_EMBEDDED_SPIRV
+        if (spirvProgram && variant.tileSize == DEFAULT_TILE_SIZE) {
+            return programs.emplace(options, *spirvProgram).first->second;
+        }
+#endif
+        LOG_DEBUG("Building kernel variant: " + options);
+        return programs.emplace(options, programCache.build(source, options)).first->second;
+    }
+};
 
 // Binner class - manages triangle collection and binning for tile-based rendering
 class Binner {
 private:
-    std::vector<TriangleMetadata> frameTriangles;
-    lr::AllPurposeBuffer<GPUTriangleData>* triangleBuffer;
-    lr::AllPurposeBuffer<uint8_t>* tileBuffer;  // Using uint8_t for raw bytes
-    std::shared_ptr<cl::Kernel> binTrianglesKernel, clearTilesKernel, renderTileKernel;
+    // Buffers are kept across frames and only grow, so steady-state frames allocate nothing
+    std::vector<GPUTriangleData> frameTriangles;
+    cl::Event triangleUpload;  // frameTriangles is read by the queue until this completes
+    
+    // Triangles of submitted meshes, appended on the GPU after the host triangles
+    struct MeshRange {
+        cl::Buffer triangles;
+        int triangleCount;
+        int vertexCount;
+        int instanceCount;
+        int vertexBase;  // First vertex of the first instance in the vertex pool
+        int texOffset;   // Mesh's texture in the texture pool (-1 if untextured)
+        std::shared_ptr<const void> owner;  // Pins the triangles' pool block until the expansion is queued
+    };
+    std::vector<MeshRange> frameMeshes;
+    int meshTriangleCount = 0;
+    lr::DynamicBuffer<GPUTriangleData> triangleBuffer;
+    lr::DynamicBuffer<GPUTriangleSetup> setupBuffer;  // Projected triangles, written by setupTriangles
+    
+    // Tile lists - layout depends on the binning mode (see binning.cl)
+    BinningMode mode;
+    lr::GPUOnlyBuffer<int>* tileCountBuffer;              // Triangles per tile, then scatter cursors
+    lr::GPUProducedAndReadBuffer<int>* tileOffsetBuffer;  // Prefix sum of the counts (totalTiles + 1 entries)
+    lr::DynamicBuffer<int> tileTriangleIdBuffer;          // Triangle IDs of all tiles
+    
+    // Required list lengths of earlier prefix-sum passes, read back without waiting for them
+    struct ListLengthRead {
+        cl::Event event;
+        std::unique_ptr<int> length;  // Written by the read
+        int triangleCount;
+        int listCapacity;  // The pass's list had room for this many entries
+    };
+    std::deque<ListLengthRead> listLengthReads;
+    double entriesPerTriangle = -1;  // Of the newest finished read, -1 before the first one
+    size_t scanGroupSize;
+    std::shared_ptr<cl::Kernel> setupTrianglesKernel, binTrianglesKernel, clearTilesKernel;
+    std::shared_ptr<cl::Kernel> countTileCoverageKernel, scanTileCountsKernel, scatterTrianglesKernel;
+    std::shared_ptr<cl::Kernel> expandMeshTrianglesKernel;
     
-    int maxTriangles;
     int screenWidth, screenHeight;
+    float scrZ;  // Projection distance
+    int tileSize;
     int tilesPerRow, tilesPerColumn, totalTiles;
-    int nextTriangleId;
+    int texturedTriangleCount = 0;  // Of this frame, decides which renderTile variant runs
+    FrameProfiler& profiler;
+    const cl::Buffer* statsBuffer = nullptr;  // Frame counters, only on counted frames
+    
+    void binFixedSlots(int triangleCount) {
+        // Fixed slots need a constant amount of entries
+        tileTriangleIdBuffer.reserve((size_t)totalTiles * MAX_TRIANGLES_PER_TILE);
+        
+        assert(binTrianglesKernel->setArg(0, setupBuffer.getCLBuffer()) == CL_SUCCESS);
+        assert(binTrianglesKernel->setArg(1, triangleCount) == CL_SUCCESS);
+        assert(binTrianglesKernel->setArg(2, tileCountBuffer->getCLBuffer()) == CL_SUCCESS);
+        assert(binTrianglesKernel->setArg(3, tileTriangleIdBuffer.getCLBuffer()) == CL_SUCCESS);
+        assert(binTrianglesKernel->setArg(4, screenWidth) == CL_SUCCESS);
+        assert(binTrianglesKernel->setArg(5, screenHeight) == CL_SUCCESS);
+        assert(binTrianglesKernel->setArg(6, tilesPerRow) == CL_SUCCESS);
+        assert(binTrianglesKernel->setArg(7, tilesPerColumn) == CL_SUCCESS);
+        bindStats(*binTrianglesKernel, 8);
+        
+        cl::NDRange binWorkSize(triangleCount);
+        assert(getGPU().getQueue().enqueueNDRangeKernel(*binTrianglesKernel, cl::NullRange, binWorkSize, cl::NullRange, nullptr, profiler.event(STAGE_BINNING, "binTriangles")) == CL_SUCCESS);
+    }
     
-    static constexpr int TILE_SIZE = 32;
-    static constexpr int MAX_TRIANGLES_PER_TILE = 256;
+    // Takes the list lengths of earlier passes that have been read back by now
+    void collectListLengths() {
+        while (!listLengthReads.empty()) {
+            ListLengthRead& read = listLengthReads.front();
+            if (read.event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE) break;
+            if (read.triangleCount > 0) entriesPerTriangle = (double)*read.length / read.triangleCount;
+            if (*read.length > read.listCapacity) {
+                LOG_DEBUG("Tile lists needed " + std::to_string(*read.length) + " entries, had room for " +
+                          std::to_string(read.listCapacity) + " - the tiles that didn't fit tested every triangle");
+            }
+            listLengthReads.pop_front();
+        }
+    }
     
-    // Calculate size of TileData structure (triangle_ids array + triangle_count)
-    size_t getTileDataSize() const {
-        return MAX_TRIANGLES_PER_TILE * sizeof(int) + sizeof(int);
+    void binPrefixSum(int triangleCount) {
+        cl::NDRange binWorkSize(triangleCount);
+        
+        // Pass 1: coverage count per tile
+        assert(countTileCoverageKernel->setArg(0, setupBuffer.getCLBuffer()) == CL_SUCCESS);
+        assert(countTileCoverageKernel->setArg(1, triangleCount) == CL_SUCCESS);
+        assert(countTileCoverageKernel->setArg(2, tileCountBuffer->getCLBuffer()) == CL_SUCCESS);
+        assert(countTileCoverageKernel->setArg(3, screenWidth) == CL_SUCCESS);
+        assert(countTileCoverageKernel->setArg(4, screenHeight) == CL_SUCCESS);
+        assert(countTileCoverageKernel->setArg(5, tilesPerRow) == CL_SUCCESS);
+        assert(countTileCoverageKernel->setArg(6, tilesPerColumn) == CL_SUCCESS);
+        assert(getGPU().getQueue().enqueueNDRangeKernel(*countTileCoverageKernel, cl::NullRange, binWorkSize, cl::NullRange, nullptr, profiler.event(STAGE_BINNING, "countTileCoverage")) == CL_SUCCESS);
+        
+        // The exact list length is only known on the device. Waiting for it would stall the
+        // queue every frame, so the list is sized from the entries per triangle of the newest
+        // pass whose length has been read back, with a quarter of headroom. When it still comes
+        // out too short, the tiles that don't fit get no list and renderTile tests all triangles
+        // for them - slower, but nothing is lost - and the next passes grow the list.
+        // Only the first pass has nothing to go on and waits.
+        collectListLengths();
+        bool estimated = entriesPerTriangle >= 0;
+        int listCapacity = INT_MAX;  // Unclamped until the first length is known
+        if (estimated) {
+            tileTriangleIdBuffer.reserve((size_t)(entriesPerTriangle * triangleCount * 1.25) + totalTiles);
+            listCapacity = (int)std::min<size_t>(tileTriangleIdBuffer.capacity(), INT_MAX);
+        }
+        
+        // Pass 2: exclusive prefix sum over tiles (single work-group)
+        assert(scanTileCountsKernel->setArg(0, tileCountBuffer->getCLBuffer()) == CL_SUCCESS);
+        assert(scanTileCountsKernel->setArg(1, tileOffsetBuffer->getCLBuffer()) == CL_SUCCESS);
+        assert(scanTileCountsKernel->setArg(2, totalTiles) == CL_SUCCESS);
+        assert(scanTileCountsKernel->setArg(3, listCapacity) == CL_SUCCESS);
+        assert(scanTileCountsKernel->setArg(4, cl::Local(scanGroupSize * sizeof(int))) == CL_SUCCESS);
+        assert(getGPU().getQueue().enqueueNDRangeKernel(*scanTileCountsKernel, cl::NullRange, cl::NDRange(scanGroupSize), cl::NDRange(scanGroupSize), nullptr, profiler.event(STAGE_BINNING, "scanTileCounts")) == CL_SUCCESS);
+        
+        ListLengthRead read{cl::Event(), std::make_unique<int>(0), triangleCount, listCapacity};
+        assert(getGPU().getQueue().enqueueReadBuffer(tileOffsetBuffer->getCLBuffer(), CL_FALSE, sizeof(int) * totalTiles, sizeof(int), read.length.get(), nullptr, &read.event) == CL_SUCCESS);
+        if (!estimated) {
+            {
+                TRACE_SCOPE("wait for tile list length");
+                read.event.wait();
+            }
+            tileTriangleIdBuffer.reserve(*read.length);
+        }
+        listLengthReads.push_back(std::move(read));
+        
+        // Pass 3: scatter triangle IDs into the compact list
+        assert(scatterTrianglesKernel->setArg(0, setupBuffer.getCLBuffer()) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(1, triangleCount) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(2, tileCountBuffer->getCLBuffer()) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(3, tileOffsetBuffer->getCLBuffer()) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(4, tileTriangleIdBuffer.getCLBuffer()) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(5, screenWidth) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(6, screenHeight) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(7, tilesPerRow) == CL_SUCCESS);
+        assert(scatterTrianglesKernel->setArg(8, tilesPerColumn) == CL_SUCCESS);
+        bindStats(*scatterTrianglesKernel, 9);
+        assert(getGPU().getQueue().enqueueNDRangeKernel(*scatterTrianglesKernel, cl::NullRange, binWorkSize, cl::NullRange, nullptr, profiler.event(STAGE_BINNING, "scatterTriangles")) == CL_SUCCESS);
+        
+        LOG_DEBUG("Prefix-sum binning into a list of " + std::to_string(tileTriangleIdBuffer.capacity()) + " entries");
     }
 
 public:
-    Binner(int screen_w, int screen_h, int max_triangles = 10000) 
-        : maxTriangles(max_triangles), screenWidth(screen_w), screenHeight(screen_h), nextTriangleId(0) {
+    Binner(int screen_w, int screen_h, float scr_z, int tile_size, FrameProfiler& profiler) 
+        : triangleBuffer(1024, lr::MEM_BINNING), setupBuffer(1024, lr::MEM_BINNING), tileTriangleIdBuffer(1024, lr::MEM_BINNING),
+          screenWidth(screen_w), screenHeight(screen_h), scrZ(scr_z), tileSize(tile_size), profiler(profiler) {
         
         // Calculate tile grid dimensions
-        tilesPerRow = (screenWidth + TILE_SIZE - 1) / TILE_SIZE;
-        tilesPerColumn = (screenHeight + TILE_SIZE - 1) / TILE_SIZE;
+        tilesPerRow = (screenWidth + tileSize - 1) / tileSize;
+        tilesPerColumn = (screenHeight + tileSize - 1) / tileSize;
         totalTiles = tilesPerRow * tilesPerColumn;
         
         LOG_DEBUG("Initializing Binner: " + std::to_string(tilesPerRow) + "x" + std::to_string(tilesPerColumn) + " tiles (" + std::to_string(totalTiles) + " total)");
         
-        // Create buffers - triangle buffer will be created dynamically in runBinningPass
-        triangleBuffer = nullptr;
-        tileBuffer = new lr::AllPurposeBuffer<uint8_t>(totalTiles * getTileDataSize());
-        
-        frameTriangles.reserve(maxTriangles);
+        tileCountBuffer = new lr::GPUOnlyBuffer<int>(totalTiles, lr::MEM_BINNING);
+        tileOffsetBuffer = new lr::GPUProducedAndReadBuffer<int>(totalTiles + 1, lr::MEM_BINNING);
+        mode = BINNING_PREFIX_SUM;
     }
     
     ~Binner() {
-        if (triangleBuffer) delete triangleBuffer;
-        delete tileBuffer;
+        // Reads still in flight write into their length
+        for (ListLengthRead& read : listLengthReads) read.event.wait();
+        delete tileCountBuffer;
+        delete tileOffsetBuffer;
     }
     
     void initKernels(cl::Program& program) {
+        setupTrianglesKernel = std::make_shared<cl::Kernel>(program, "setupTriangles");
         binTrianglesKernel = std::make_shared<cl::Kernel>(program, "binTriangles");
         clearTilesKernel = std::make_shared<cl::Kernel>(program, "clearTiles");
-        renderTileKernel = std::make_shared<cl::Kernel>(program, "renderTile");
+        countTileCoverageKernel = std::make_shared<cl::Kernel>(program, "countTileCoverage");
+        scanTileCountsKernel = std::make_shared<cl::Kernel>(program, "scanTileCounts");
+        scatterTrianglesKernel = std::make_shared<cl::Kernel>(program, "scatterTriangles");
+        expandMeshTrianglesKernel = std::make_shared<cl::Kernel>(program, "expandMeshTriangles");
+        
+        // The scan runs on a single work-group - on a CPU that's one core, where a wide group only adds barrier overhead
+        size_t preferredScanGroupSize = getGPU().isCPU() ? 64 : 256;
+        scanGroupSize = std::min<size_t>(preferredScanGroupSize, scanTileCountsKernel->getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(getGPU().getDevice()));
         
         LOG_DEBUG("Binner kernels initialized successfully");
     }
     
-    // Add a solid color triangle to the frame
-    void addTriangle(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx, int color) {
-        if (frameTriangles.size() >= maxTriangles) {
-            LOG_ERR("Maximum triangles per frame exceeded!");
-            return;
-        }
-        
-        TriangleMetadata triangle = {};
-        triangle.vertexBuffer = const_cast<cl::Buffer*>(&vertexBuffer.getCLBuffer());
+    // Add a solid color triangle to the frame (indices point into the vertex pool)
+    void addTriangle(int v0_idx, int v1_idx, int v2_idx, int color) {
+        GPUTriangleData triangle = {};
         triangle.v0_idx = v0_idx;
         triangle.v1_idx = v1_idx;
         triangle.v2_idx = v2_idx;
-        triangle.texture = nullptr;  // No texture
+        triangle.tex_offset = -1;  // No texture
         triangle.color = color;
-        triangle.triangle_id = nextTriangleId++;
         
         frameTriangles.push_back(triangle);
     }
     
-    // Add a textured triangle to the frame
-    void addTexturedTriangle(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx,
-                           const TexCoord& ta, const TexCoord& tb, const TexCoord& tc, const Texture& texture) {
-        if (frameTriangles.size() >= maxTriangles) {
-            LOG_ERR("Maximum triangles per frame exceeded!");
-            return;
-        }
-        
-        TriangleMetadata triangle = {};
-        triangle.vertexBuffer = const_cast<cl::Buffer*>(&vertexBuffer.getCLBuffer());
+    // Add a textured triangle to the frame (indices point into the vertex pool,
+    // texOffset into the texture pool)
+    void addTexturedTriangle(int v0_idx, int v1_idx, int v2_idx,
+                           const TexCoord& ta, const TexCoord& tb, const TexCoord& tc,
+                           int texOffset, int texWidth, int texHeight) {
+        GPUTriangleData triangle = {};
         triangle.v0_idx = v0_idx;
         triangle.v1_idx = v1_idx;
         triangle.v2_idx = v2_idx;
         triangle.tex_coords[0] = ta.u; triangle.tex_coords[1] = ta.v;
         triangle.tex_coords[2] = tb.u; triangle.tex_coords[3] = tb.v;
         triangle.tex_coords[4] = tc.u; triangle.tex_coords[5] = tc.v;
-        triangle.texture = const_cast<cl::Buffer*>(&texture.getCLBuffer());
-        triangle.tex_width = texture.getWidth();
-        triangle.tex_height = texture.getHeight();
-        triangle.triangle_id = nextTriangleId++;
+        triangle.tex_offset = texOffset;
+        triangle.tex_width = texWidth;
+        triangle.tex_height = texHeight;
         
         frameTriangles.push_back(triangle);
+        texturedTriangleCount++;
+    }
+    
+    // Add all triangles of instanceCount instances of a mesh whose vertices are in the vertex pool
+    void addMesh(const Mesh& mesh, int instanceCount, int vertexBase, int texOffset) {
+        frameMeshes.push_back({mesh.getTriangleBuffer().getCLBuffer(), (int)mesh.getTriangleCount(), (int)mesh.getVertexCount(),
+                               instanceCount, vertexBase, texOffset, mesh.getTriangleBuffer().getAllocation()});
+        meshTriangleCount += (int)mesh.getTriangleCount() * instanceCount;
+        if (texOffset >= 0) texturedTriangleCount += (int)mesh.getTriangleCount() * instanceCount;
     }
     
     // Upload triangle data to GPU and run binning pass
-    void runBinningPass() {
-        if (frameTriangles.empty()) {
+    void runBinningPass(const cl::Buffer& vertexPool) {
+        TRACE_SCOPE("runBinningPass");
+        int triangleCount = (int)frameTriangles.size() + meshTriangleCount;
+        if (triangleCount == 0) {
             LOG_DEBUG("No triangles to bin - skipping binning pass");
             return;
         }
         
-        LOG_DEBUG("Running binning pass for " + std::to_string(frameTriangles.size()) + " triangles");
+        LOG_DEBUG("Running binning pass for " + std::to_string(triangleCount) + " triangles");
         
-        // Convert CPU triangle metadata to GPU format
-        std::vector<GPUTriangleData> gpuTriangles;
-        gpuTriangles.reserve(frameTriangles.size());
+        // Upload only the host triangles of this frame. startNewFrame waits for the
+        // upload before frameTriangles is reused.
+        // Growing to the full count keeps the uploaded range (the copy is queued after the write).
+        uint64_t enqueued = lr::trace::now();
+        triangleBuffer.writeFrom(frameTriangles, false, &triangleUpload);
+        profiler.record(STAGE_UPLOAD, "write triangles", triangleUpload, enqueued);
+        triangleBuffer.resize(triangleCount);
         
-        for (const auto& triangle : frameTriangles) {
-            GPUTriangleData gpuTriangle = {};
-            gpuTriangle.vertexBuffer = triangle.vertexBuffer->get();  // Get raw cl_mem handle
-            gpuTriangle.v0_idx = triangle.v0_idx;
-            gpuTriangle.v1_idx = triangle.v1_idx;
-            gpuTriangle.v2_idx = triangle.v2_idx;
-            for (int i = 0; i < 6; i++) {
-                gpuTriangle.tex_coords[i] = triangle.tex_coords[i];
-            }
-            gpuTriangle.texture = triangle.texture ? triangle.texture->get() : 0;  // 0 for solid color
-            gpuTriangle.tex_width = triangle.tex_width;
-            gpuTriangle.tex_height = triangle.tex_height;
-            gpuTriangle.color = triangle.color;
-            gpuTriangle.triangle_id = triangle.triangle_id;
-            
-            gpuTriangles.push_back(gpuTriangle);
+        // Mesh triangles are copied (and instances expanded) on the GPU behind the host triangles
+        int firstTriangle = (int)frameTriangles.size();
+        for (const MeshRange& range : frameMeshes) {
+            int rangeTriangles = range.triangleCount * range.instanceCount;
+            assert(expandMeshTrianglesKernel->setArg(0, range.triangles) == CL_SUCCESS);
+            assert(expandMeshTrianglesKernel->setArg(1, range.triangleCount) == CL_SUCCESS);
+            assert(expandMeshTrianglesKernel->setArg(2, range.vertexCount) == CL_SUCCESS);
+            assert(expandMeshTrianglesKernel->setArg(3, range.instanceCount) == CL_SUCCESS);
+            assert(expandMeshTrianglesKernel->setArg(4, triangleBuffer.getCLBuffer()) == CL_SUCCESS);
+            assert(expandMeshTrianglesKernel->setArg(5, firstTriangle) == CL_SUCCESS);
+            assert(expandMeshTrianglesKernel->setArg(6, range.vertexBase) == CL_SUCCESS);
+            assert(expandMeshTrianglesKernel->setArg(7, range.texOffset) == CL_SUCCESS);
+            assert(getGPU().getQueue().enqueueNDRangeKernel(*expandMeshTrianglesKernel, cl::NullRange, cl::NDRange(rangeTriangles), cl::NullRange, nullptr, profiler.event(STAGE_TRANSFORM, "expandMeshTriangles")) == CL_SUCCESS);
+            firstTriangle += rangeTriangles;
         }
         
-        // Create triangle buffer with correct size for this frame
-        if (triangleBuffer) delete triangleBuffer;
-        triangleBuffer = new lr::AllPurposeBuffer<GPUTriangleData>(gpuTriangles.size(), gpuTriangles);
-        LOG_DEBUG("Created triangle buffer with " + std::to_string(gpuTriangles.size()) + " triangles");
+        setupBuffer.clear();
+        setupBuffer.resize(triangleCount);
+        
+        // Project every triangle once - binning and tile rendering only read the setup data
+        assert(setupTrianglesKernel->setArg(0, triangleBuffer.getCLBuffer()) == CL_SUCCESS);
+        assert(setupTrianglesKernel->setArg(1, triangleCount) == CL_SUCCESS);
+        assert(setupTrianglesKernel->setArg(2, setupBuffer.getCLBuffer()) == CL_SUCCESS);
+        assert(setupTrianglesKernel->setArg(3, vertexPool) == CL_SUCCESS);
+        assert(setupTrianglesKernel->setArg(4, screenWidth) == CL_SUCCESS);
+        assert(setupTrianglesKernel->setArg(5, screenHeight) == CL_SUCCESS);
+        assert(setupTrianglesKernel->setArg(6, scrZ) == CL_SUCCESS);
+        bindStats(*setupTrianglesKernel, 7);
+        
+        cl::NDRange setupWorkSize(triangleCount);
+        assert(getGPU().getQueue().enqueueNDRangeKernel(*setupTrianglesKernel, cl::NullRange, setupWorkSize, cl::NullRange, nullptr, profiler.event(STAGE_BINNING, "setupTriangles")) == CL_SUCCESS);
         
-        // Clear tile data
-        assert(clearTilesKernel->setArg(0, tileBuffer->getCLBuffer()) == CL_SUCCESS);
+        // Clear tile counters
+        assert(clearTilesKernel->setArg(0, tileCountBuffer->getCLBuffer()) == CL_SUCCESS);
         assert(clearTilesKernel->setArg(1, totalTiles) == CL_SUCCESS);
         
         cl::NDRange clearWorkSize(totalTiles);
-        assert(getGPU().getQueue().enqueueNDRangeKernel(*clearTilesKernel, cl::NullRange, clearWorkSize, cl::NullRange) == CL_SUCCESS);
+        assert(getGPU().getQueue().enqueueNDRangeKernel(*clearTilesKernel, cl::NullRange, clearWorkSize, cl::NullRange, nullptr, profiler.event(STAGE_BINNING, "clearTiles")) == CL_SUCCESS);
         
-        // Run binning kernel
-        assert(binTrianglesKernel->setArg(0, triangleBuffer->getCLBuffer()) == CL_SUCCESS);
-        assert(binTrianglesKernel->setArg(1, (int)gpuTriangles.size()) == CL_SUCCESS);
-        assert(binTrianglesKernel->setArg(2, tileBuffer->getCLBuffer()) == CL_SUCCESS);
-        assert(binTrianglesKernel->setArg(3, screenWidth) == CL_SUCCESS);
-        assert(binTrianglesKernel->setArg(4, screenHeight) == CL_SUCCESS);
-        assert(binTrianglesKernel->setArg(5, tilesPerRow) == CL_SUCCESS);
-        assert(binTrianglesKernel->setArg(6, tilesPerColumn) == CL_SUCCESS);
-        
-        cl::NDRange binWorkSize(gpuTriangles.size());
-        assert(getGPU().getQueue().enqueueNDRangeKernel(*binTrianglesKernel, cl::NullRange, binWorkSize, cl::NullRange) == CL_SUCCESS);
+        // Run binning kernels
+        if (mode == BINNING_FIXED_SLOTS) {
+            binFixedSlots(triangleCount);
+        } else {
+            binPrefixSum(triangleCount);
+        }
         
         LOG_DEBUG("Binning pass completed");
     }
     
     // Reset for next frame
     void startNewFrame() {
+        // The previous frame may still be in flight - only its upload has to be done
+        if (triangleUpload()) {
+            triangleUpload.wait();
+            triangleUpload = cl::Event();
+        }
         frameTriangles.clear();
-        nextTriangleId = 0;
+        frameMeshes.clear();
+        meshTriangleCount = 0;
+        texturedTriangleCount = 0;
         LOG_DEBUG("Started new frame - triangle list cleared");
     }
     
+    // Frame counters for the next binning pass, nullptr for a frame that isn't counted
+    void setStatsBuffer(const cl::Buffer* buffer) { statsBuffer = buffer; }
+    
+    // A NULL pointer tells the kernels not to count
+    void bindStats(cl::Kernel& kernel, int arg) const {
+        if (statsBuffer) {
+            assert(kernel.setArg(arg, *statsBuffer) == CL_SUCCESS);
+        } else {
+            assert(kernel.setArg(arg, sizeof(cl_mem), nullptr) == CL_SUCCESS);
+        }
+    }
+    
+    void setMode(BinningMode newMode) {
+        // The list is rebuilt every pass, so its allocation is shared by both layouts
+        mode = newMode;
+    }
+    BinningMode getMode() const { return mode; }
+    
+    // Binds the tile lists of the last binning pass to renderTile arguments [firstArg, firstArg + 3)
+    void bindTileLists(cl::Kernel& kernel, int firstArg) const {
+        if (mode == BINNING_FIXED_SLOTS) {
+            assert(kernel.setArg(firstArg, tileCountBuffer->getCLBuffer()) == CL_SUCCESS);
+            assert(kernel.setArg(firstArg + 2, MAX_TRIANGLES_PER_TILE) == CL_SUCCESS);
+        } else {
+            assert(kernel.setArg(firstArg, tileOffsetBuffer->getCLBuffer()) == CL_SUCCESS);
+            assert(kernel.setArg(firstArg + 2, 0) == CL_SUCCESS);
+        }
+        assert(kernel.setArg(firstArg + 1, tileTriangleIdBuffer.getCLBuffer()) == CL_SUCCESS);
+    }
+    
     // Provide access to tile and triangle data for _Renderer to use in tile-based rendering
-    const lr::AllPurposeBuffer<uint8_t>* getTileBuffer() const { return tileBuffer; }
-    const lr::AllPurposeBuffer<GPUTriangleData>* getTriangleBuffer() const { return triangleBuffer; }
-    std::shared_ptr<cl::Kernel> getRenderTileKernel() const { return renderTileKernel; }
+    const lr::DynamicBuffer<GPUTriangleData>& getTriangleBuffer() const { return triangleBuffer; }
+    const lr::DynamicBuffer<GPUTriangleSetup>& getSetupBuffer() const { return setupBuffer; }
     
     // Get statistics
-    int getTriangleCount() const { return frameTriangles.size(); }
+    int getTriangleCount() const { return frameTriangles.size() + meshTriangleCount; }
+    bool hasTexturedTriangles() const { return texturedTriangleCount > 0; }
     int getTileCount() const { return totalTiles; }
     int getTilesPerRow() const { return tilesPerRow; }
     int getTilesPerColumn() const { return tilesPerColumn; }
+    int getTileSize() const { return tileSize; }
 };
 
+// The mode LR_READBACK asks for, mode if it isn't set
+ReadbackMode readbackModeFromEnvironment(ReadbackMode mode) {
+    if (const char* value = std::getenv("LR_READBACK")) {
+        std::string name = value;
+        if (name == "auto") mode = READBACK_AUTO;
+        else if (name == "copy") mode = READBACK_COPY;
+        else if (name == "mapped") mode = READBACK_MAPPED;
+        else LOG_ERR("Unknown LR_READBACK value '" + name + "' - ignored");
+    }
+    return mode;
+}
+
+// Resolves READBACK_AUTO for the current device
+ReadbackMode resolveReadbackMode(ReadbackMode mode) {
+    if (mode == READBACK_AUTO) return getGPU().hasUnifiedMemory() ? READBACK_MAPPED : READBACK_COPY;
+    return mode;
+}
+
 class _Renderer {
     private:
         int32_t n, maxx, maxy;
         int32_t scr_z;
-        uint32_t *colorArr;
-        std::shared_ptr<cl::Buffer> depth, color, globalData; 
+        
+        // One render target per frame in flight (one more with mapped readback). Frame k renders into
+        // targets[k % targets.size()] and is read back asynchronously into the target's host copy,
+        // or mapped for the host to read in place.
+        struct FrameTarget {
+            std::shared_ptr<cl::Buffer> depth, color, globalData;
+            std::shared_ptr<const void> memory;  // Memory tracker registration of the three buffers
+            std::vector<uint32_t> hostColor;  // Empty with mapped readback
+            uint32_t* mappedColor = nullptr;  // The mapped color buffer, until the target is reused
+            cl::Event readback;               // Read or map of the color buffer
+            FrameProfiler::FrameEvents profile;  // Commands of the frame, timed once it's read back
+            std::array<uint32_t, STAT_COUNT> statCounters;  // Read back with the frame if it was counted
+            std::optional<FrameStats> stats;
+        };
+        std::vector<FrameTarget> targets;
+        int currentTarget = 0;
+        std::deque<int> pendingTargets;  // Read back but not returned by finishFrame yet, oldest first
+        uint32_t* lastFrame = nullptr;   // Returned by the last finishFrame
+        uint64_t returnedFrames = 0;     // Frames finishFrame returned so far
+        int framesInFlight;
+        ReadbackMode readbackMode;       // READBACK_COPY or READBACK_MAPPED
+        uint32_t globalDataSize = 0;     // Of the kernels' per-target global data struct
         std::shared_ptr<cl::Program> drawFunctions;
         std::shared_ptr<cl::Kernel> clearingKernel;  // Only clearing kernel still needed
+        std::shared_ptr<cl::Kernel> transformVerticesKernel;  // Mesh vertices to camera space
+        
+        // Kernels are specialized for this renderer's screen, projection and tile size
+        std::unique_ptr<KernelVariantCache> kernelVariants;
+        std::shared_ptr<cl::Kernel> renderTileKernels[2];  // [textured], the untextured one is built on first use
+        
+        // Device time per stage, only collected on a profiling queue
+        FrameProfiler profiler;
+        
+        // Frame counters, filled by the kernels on every statsInterval-th frame
+        int statsInterval = 0;
+        uint64_t frameNumber = 0;
+        bool countingFrame = false;
+        cl::Buffer statsBuffer;
+        std::shared_ptr<const void> statsMemory;  // Memory tracker registration of statsBuffer
+        std::optional<FrameStats> lastStats;
         
         // Binner for tile-based rendering
         std::unique_ptr<Binner> binner;
         
+        // All geometry and textures referenced by this frame's triangles.
+        // Vertex buffers are copied in once per frame, textures stay until they go unused
+        // for TEXTURE_POOL_MAX_UNUSED_FRAMES frames (see BufferPool::startFrame).
+        static constexpr uint64_t TEXTURE_POOL_MAX_UNUSED_FRAMES = 60;
+        BufferPool<vec> vertexPool{1 << 16, profiler, "copy vertices"};
+        BufferPool<uint32_t> texturePool{1 << 20, profiler, "copy texture"};
+        // Vertices rebuilt by the host every frame (e.g. camera-transformed shapes), uploaded in one write
+        lr::StreamingBuffer<vec> vertexStream;
+        
+        // Mesh draws of this frame. Their vertices are transformed in executeBinningPass,
+        // after all instance transforms of the frame went to the GPU in one upload.
+        struct MeshDraw {
+            cl::Buffer vertices;
+            int vertexCount;
+            int firstInstance;  // -1 for a mesh drawn without a model matrix
+            int instanceCount;
+            int vertexBase;     // Destination in the vertex pool
+            std::shared_ptr<const void> owner;  // Pins the vertices' pool block until the transform is queued
+        };
+        std::vector<MeshDraw> frameMeshDraws;
+        std::vector<Transform> frameInstances;
+        lr::DynamicBuffer<Transform> instanceBuffer{256, lr::MEM_FRAME};
+        cl::Event instanceUpload;  // frameInstances is read by the queue until this completes
+        
+        // Work-group shape of the renderTile dispatch (one work-group per tile)
+        TileConfig requestedTiles;  // Fields left at 0 get the device defaults
+        size_t tileLocalX = 0, tileLocalY = 0;  // Set by initRenderTileShape
+        
         // Camera for 3D transformations
         Camera camera;
 
         bool isFirstDraw = true;
 
         std::string getCode(const std::string& filename) {
-            std::ifstream file(filename);
+#ifdef LR_EMBEDDED_KERNELS
+            // Kernels compiled into the executable by CMake (see cmake/EmbedKernels.cmake)
+            for (const EmbeddedKernelSource& kernel : embeddedKernelSources) {
+                if (filename == kernel.name) return kernel.code;
+            }
+            std::cerr << "Kernel source not embedded: " << filename << std::endl;
+            exit(1);
+#else
+            std::string path = "../src/cl_scripts/" + filename;
+            std::ifstream file(path);
             if (!file.is_open()) {
-                std::cerr << "Failed to open kernel source file: " << filename << std::endl;
+                std::cerr << "Failed to open kernel source file: " << path << std::endl;
                 exit(1);
             }
             std::stringstream ss;
             ss << file.rdbuf();
             return ss.str();
+#endif
         }
 
         std::string getCombinedKernelCode() {
-            // Load and combine all OpenCL files
+            // Load and combine all OpenCL files (CMakeLists.txt lists them in the same order)
             std::string combined = "";
             
             // Common types and utilities first
-            combined += getCode("../src/cl_scripts/common.cl");
+            combined += getCode("common.cl");
             combined += "\n\n";
             
             // Rasterization kernels
-            combined += getCode("../src/cl_scripts/rasterization.cl");
+            combined += getCode("rasterization.cl");
             combined += "\n\n";
             
             // Binning kernels
-            combined += getCode("../src/cl_scripts/binning.cl");
+            combined += getCode("binning.cl");
+            combined += "\n\n";
+            
+            // Mesh vertex transform and triangle expansion
+            combined += getCode("transform.cl");
             combined += "\n\n";
             
             return combined;
         }
 
+        KernelVariant makeVariant(bool textured) const {
+            return {binner->getTileSize(), maxx, maxy, (float)scr_z, textured};
+        }
+
 
         void initOpenCL() {
             assert(getGPU().isInitialized());
 
-            cl::Program::Sources sources;
-           
-            std::string sourceCode = getCombinedKernelCode();
-            sources.push_back({sourceCode.c_str(), sourceCode.length()});
-
-            cl::Program program(getGPU().getContext(), sources);
-            program.build("-cl-std=CL3.0");
+            // Compiled binaries are cached on disk, so only the first run pays for the build
+            kernelVariants = std::make_unique<KernelVariantCache>(getCombinedKernelCode());
+            cl::Program& program = kernelVariants->get(makeVariant(true));
 
             
             uint32_t addressBits = getGPU().getDevice().getInfo<CL_DEVICE_ADDRESS_BITS>();
 
             cl::Buffer globalDataSizeBuffer(getGPU().getContext(),CL_MEM_READ_WRITE,sizeof(uint32_t));
-            uint32_t globalDataSize;
             cl::Kernel globalDataSizeKernel(program,"getGlobalDataSize");
 
             cl::NDRange global_work_size(1);
@@ -409,33 +1138,73 @@ class _Renderer {
             getGPU().getQueue().flush();
 
 
-            depth = std::make_shared<cl::Buffer>(getGPU().getContext(), CL_MEM_READ_WRITE, sizeof(float) * n);
-            color = std::make_shared<cl::Buffer>(getGPU().getContext(), CL_MEM_READ_WRITE, sizeof(uint32_t) * n);
-            globalData = std::make_shared<cl::Buffer>(getGPU().getContext(),CL_MEM_READ_ONLY,globalDataSize); // wiele
+            allocateTargets(program);
 
-            cl::Kernel globalDataKernel(program,"makeGlobalData"); 
-            assert(globalDataKernel.setArg(0, *depth) == CL_SUCCESS); 
-            assert(globalDataKernel.setArg(1, *color) == CL_SUCCESS); 
-            assert(globalDataKernel.setArg(2, *globalData) == CL_SUCCESS); 
-            assert(globalDataKernel.setArg(3, maxx) == CL_SUCCESS); 
-            assert(globalDataKernel.setArg(4, maxy) == CL_SUCCESS); 
- 
-            assert(getGPU().getQueue().enqueueNDRangeKernel(globalDataKernel,cl::NullRange,global_work_size,cl::NullRange) == CL_SUCCESS);
-            getGPU().getQueue().flush();
 
+            statsBuffer = cl::Buffer(getGPU().getContext(), CL_MEM_READ_WRITE, sizeof(uint32_t) * STAT_COUNT);
+            statsMemory = lr::memory::track(lr::MEM_RENDER_TARGET, sizeof(uint32_t) * STAT_COUNT);
 
             // Create the OpenCL kernels
             clearingKernel = std::make_shared<cl::Kernel>(program,"clear");
-            assert(clearingKernel->setArg(0, *depth) == CL_SUCCESS);
-            assert(clearingKernel->setArg(1, *color) == CL_SUCCESS);
+            // Arguments 0-1 (the frame's target) are set by clear()
             assert(clearingKernel->setArg(2, maxx) == CL_SUCCESS); 
 
             // Old drawing kernels removed - only binning kernels used now 
             
+            transformVerticesKernel = std::make_shared<cl::Kernel>(program, "transformVertices");
+            
             // Initialize binner kernels
             binner->initKernels(program);
+            initRenderTileShape(*getRenderTileKernel(true));
         }    
 
+        // Picks the work-group shape for renderTile (one work-group per tile)
+        void initRenderTileShape(cl::Kernel& renderTileKernel) {
+            cl::Device& device = getGPU().getDevice();
+            size_t tileSize = binner->getTileSize();
+            size_t maxGroupSize = renderTileKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+            std::vector<size_t> maxItemSizes = device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
+
+            if (requestedTiles.localX > 0 && requestedTiles.localY > 0 &&
+                tileSize % requestedTiles.localX == 0 && tileSize % requestedTiles.localY == 0) {
+                tileLocalX = requestedTiles.localX;
+                tileLocalY = requestedTiles.localY;
+            } else {
+                if (requestedTiles.localX > 0 || requestedTiles.localY > 0) {
+                    LOG_ERR("renderTile work-group " + std::to_string(requestedTiles.localX) + "x" + std::to_string(requestedTiles.localY) +
+                            " doesn't divide the tile size " + std::to_string(tileSize) + " - using the default");
+                }
+                // Ideally a work-group covers a whole tile.
+                // CPU runtimes run a work-group on one core and pay for every barrier per work-item,
+                // so there a quarter of the tile per pass is enough.
+                tileLocalX = tileSize;
+                tileLocalY = getGPU().isCPU() ? std::max<size_t>(tileSize / 4, 1) : tileSize;
+            }
+            // Devices with smaller work-groups get a smaller shape and the kernel loops over the rest of the tile
+            while (tileLocalX * tileLocalY > maxGroupSize || tileLocalX > maxItemSizes[0] || tileLocalY > maxItemSizes[1]) {
+                if (tileLocalY >= tileLocalX) tileLocalY /= 2;
+                else tileLocalX /= 2;
+            }
+            // renderTile relies on it for its barriers
+            assert(tileSize % tileLocalX == 0 && tileSize % tileLocalY == 0);
+            LOG_DEBUG("renderTile work-group: " + std::to_string(tileLocalX) + "x" + std::to_string(tileLocalY));
+        }
+
+        // renderTile of the given variant, with the arguments that stay the same
+        // for the whole lifetime of the renderer already bound
+        std::shared_ptr<cl::Kernel> getRenderTileKernel(bool textured) {
+            std::shared_ptr<cl::Kernel>& kernel = renderTileKernels[textured];
+            if (!kernel) {
+                kernel = std::make_shared<cl::Kernel>(kernelVariants->get(makeVariant(textured)), "renderTile");
+                assert(kernel->setArg(2, maxx) == CL_SUCCESS);
+                assert(kernel->setArg(3, maxy) == CL_SUCCESS);
+                assert(kernel->setArg(4, binner->getTilesPerRow()) == CL_SUCCESS);
+                // Arguments 0-1 (the frame's target) and 5-11 (tile lists, setup buffer, texture pool, stats, setup count)
+                // can change with every frame
+            }
+            return kernel;
+        }
+
 
         // Old direct triangle drawing method removed - use binning system instead
 
@@ -445,49 +1214,285 @@ class _Renderer {
 
     public:
 
-        _Renderer(int scr_w, int scr_h, int scr_z) : n((scr_w+1)*(scr_h+1)+1), maxx(scr_w), maxy(scr_h), scr_z(scr_z){
-            colorArr = new uint32_t[n];
+        _Renderer(int scr_w, int scr_h, int scr_z, int framesInFlight, const TileConfig& tiles)
+            : n((scr_w+1)*(scr_h+1)+1), maxx(scr_w), maxy(scr_h), scr_z(scr_z),
+              framesInFlight(std::max(framesInFlight, 1)), readbackMode(resolveReadbackMode(readbackModeFromEnvironment(READBACK_AUTO))),
+              vertexStream(1 << 14, std::max(framesInFlight, 1)), requestedTiles(tiles){
             
             // Initialize binner
-            binner = std::make_unique<Binner>(scr_w, scr_h);
+            // Powers of two only: halving a work-group dimension that divides the tile
+            // (initRenderTileShape) then always leaves one that still divides it
+            int tileSize = DEFAULT_TILE_SIZE;
+            if (tiles.tileSize >= 4 && tiles.tileSize <= 256 && std::has_single_bit((unsigned)tiles.tileSize)) {
+                tileSize = tiles.tileSize;
+            } else if (tiles.tileSize != 0) {
+                LOG_ERR("Unsupported tile size " + std::to_string(tiles.tileSize) + " - using " + std::to_string(DEFAULT_TILE_SIZE));
+            }
+            binner = std::make_unique<Binner>(scr_w, scr_h, scr_z, tileSize, profiler);
             
             initOpenCL();
         }
         ~_Renderer(){
-            delete colorArr;
+            // Readbacks still write into the targets' host copies
+            for (FrameTarget& target : targets) unmapColor(target);
+            getGPU().getQueue().finish();
+        }
+        
+        // Creates one render target per frame in flight for the current readback mode
+        void allocateTargets(cl::Program& program) {
+            // Mapped color buffers are handed out as they are, so the target of the returned frame
+            // can't be reused until the next finishFrame - one more target keeps framesInFlight frames queued
+            targets.clear();
+            targets.resize(readbackMode == READBACK_MAPPED ? framesInFlight + 1 : framesInFlight);
+            pendingTargets.clear();
+            currentTarget = 0;
+            lastFrame = nullptr;
+
+            cl::NDRange global_work_size(1);
+            for (FrameTarget& target : targets) {
+                target.depth = std::make_shared<cl::Buffer>(getGPU().getContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), sizeof(float) * n);
+                if (readbackMode == READBACK_MAPPED) {
+                    target.color = std::make_shared<cl::Buffer>(getGPU().getContext(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(uint32_t) * n);
+                } else {
+                    target.color = std::make_shared<cl::Buffer>(getGPU().getContext(), CL_MEM_READ_WRITE | gpuAllocFlags(), sizeof(uint32_t) * n);
+                    target.hostColor.resize(n);
+                }
+                target.globalData = std::make_shared<cl::Buffer>(getGPU().getContext(),CL_MEM_READ_ONLY,globalDataSize); // wiele
+                target.memory = lr::memory::track(lr::MEM_RENDER_TARGET, (sizeof(float) + sizeof(uint32_t)) * n + globalDataSize);
+
+                cl::Kernel globalDataKernel(program,"makeGlobalData"); 
+                assert(globalDataKernel.setArg(0, *target.depth) == CL_SUCCESS); 
+                assert(globalDataKernel.setArg(1, *target.color) == CL_SUCCESS); 
+                assert(globalDataKernel.setArg(2, *target.globalData) == CL_SUCCESS); 
+                assert(globalDataKernel.setArg(3, maxx) == CL_SUCCESS); 
+                assert(globalDataKernel.setArg(4, maxy) == CL_SUCCESS); 
+     
+                assert(getGPU().getQueue().enqueueNDRangeKernel(globalDataKernel,cl::NullRange,global_work_size,cl::NullRange) == CL_SUCCESS);
+            }
+            getGPU().getQueue().flush();
+        }
+
+        // A mapped color buffer must be unmapped before kernels write to it again
+        void unmapColor(FrameTarget& target) {
+            if (!target.mappedColor) return;
+            assert(getGPU().getQueue().enqueueUnmapMemObject(*target.color, target.mappedColor, nullptr, profiler.event(STAGE_READBACK, "unmap color buffer")) == CL_SUCCESS);
+            target.mappedColor = nullptr;
+        }
+
+        void setReadbackMode(ReadbackMode mode) {
+            ReadbackMode resolved = resolveReadbackMode(mode);
+            if (resolved == readbackMode) return;
+            for (FrameTarget& target : targets) unmapColor(target);
+            getGPU().getQueue().finish();
+            readbackMode = resolved;
+            allocateTargets(kernelVariants->get(makeVariant(true)));
+            LOG_INFO(std::string("Color readback: ") + (readbackMode == READBACK_MAPPED ? "mapped" : "copy"));
         }
+
+        ReadbackMode getReadbackMode() const {
+            return readbackMode;
+        }
+
+        // Queues the readback of the current frame and returns the frame submitted framesInFlight - 1
+        // calls ago, waiting for it if it isn't done yet. framesInFlight - 1 frames stay queued behind
+        // the returned one, so the CPU can work on the next frame while the device renders. The first
+        // framesInFlight - 1 calls have no frame that old and return nullptr without waiting.
+        // Every returned frame is newer than the one before. The pixels stay valid until the next call.
         uint32_t* finishFrame() {
+            TRACE_SCOPE("finishFrame");
             isFirstDraw = true;
+            FrameTarget& target = targets[currentTarget];
+            target.stats.reset();
+            if (countingFrame) {
+                // Read ahead of the color buffer, so it's done when the frame is
+                assert(getGPU().getQueue().enqueueReadBuffer(statsBuffer, CL_FALSE, 0, sizeof(uint32_t) * STAT_COUNT, target.statCounters.data(), nullptr, profiler.event(STAGE_READBACK, "read frame stats")) == CL_SUCCESS);
+                target.stats = FrameStats();
+                target.stats->frame = frameNumber;
+                target.stats->submitted = binner->getTriangleCount();
+            }
+            countingFrame = false;
+            frameNumber++;
+            uint64_t enqueued = lr::trace::now();
+            if (readbackMode == READBACK_MAPPED) {
+                cl_int err;
+                target.mappedColor = (uint32_t*)getGPU().getQueue().enqueueMapBuffer(*target.color, CL_FALSE, CL_MAP_READ, 0, sizeof(uint32_t) * n, nullptr, &target.readback, &err);
+                assert(err == CL_SUCCESS);
+                profiler.record(STAGE_READBACK, "map color buffer", target.readback, enqueued);
+            } else {
+                assert(getGPU().getQueue().enqueueReadBuffer(*target.color, CL_FALSE, 0, sizeof(uint32_t) * n, target.hostColor.data(), nullptr, &target.readback) == CL_SUCCESS);
+                profiler.record(STAGE_READBACK, "read color buffer", target.readback, enqueued);
+            }
+            target.profile = profiler.takeFrame();
             getGPU().getQueue().flush();
-            getGPU().getQueue().enqueueReadBuffer(*color, CL_TRUE, 0, sizeof(uint32_t) * n, colorArr);
-            return colorArr;
+            pendingTargets.push_back(currentTarget);
+            currentTarget = (currentTarget + 1) % targets.size();
+            
+            if (pendingTargets.size() < (size_t)framesInFlight) return nullptr;
+            completeOldestFrame();
+            return lastFrame;
+        }
+
+        uint32_t* finishPendingFrame() {
+            if (pendingTargets.empty()) return nullptr;
+            completeOldestFrame();
+            return lastFrame;
+        }
+
+        // Waits for the oldest pending frame and makes it lastFrame
+        void completeOldestFrame() {
+            FrameTarget& done = targets[pendingTargets.front()];
+            pendingTargets.pop_front();
+            {
+                TRACE_SCOPE("wait for frame");
+                done.readback.wait();
+            }
+            lastFrame = done.mappedColor ? done.mappedColor : done.hostColor.data();
+            returnedFrames++;
+            profiler.resolve(done.profile);  // The queue is in order - the whole frame is done
+            if (done.stats) {
+                FrameStats& stats = *done.stats;
+                stats.culledNear = done.statCounters[STAT_CULLED_NEAR];
+                stats.culledDegenerate = done.statCounters[STAT_CULLED_DEGENERATE];
+                stats.culledOffscreen = done.statCounters[STAT_CULLED_OFFSCREEN];
+                stats.binEntries = done.statCounters[STAT_BIN_ENTRIES];
+                stats.binOverflows = done.statCounters[STAT_BIN_OVERFLOWS];
+                stats.pixelsTested = done.statCounters[STAT_PIXELS_TESTED];
+                stats.pixelsWritten = done.statCounters[STAT_PIXELS_WRITTEN];
+                lastStats = stats;
+            }
         }
 
+        // Frame number of lastFrame, counting the frames finishFrame returned from 0
+        uint64_t lastFrameNumber() const { return returnedFrames - 1; }
+        int getWidth() const { return maxx; }
+        int getHeight() const { return maxy; }
+
         void clear(){
+            FrameTarget& target = targets[currentTarget];
+            unmapColor(target);
+            assert(clearingKernel->setArg(0, *target.depth) == CL_SUCCESS);
+            assert(clearingKernel->setArg(1, *target.color) == CL_SUCCESS);
             cl::NDRange global_work_size(maxx+1, maxy+1);
-            assert(getGPU().getQueue().enqueueNDRangeKernel(*clearingKernel, cl::NullRange, global_work_size, cl::NullRange)==CL_SUCCESS);
+            assert(getGPU().getQueue().enqueueNDRangeKernel(*clearingKernel, cl::NullRange, global_work_size, cl::NullRange, nullptr, profiler.event(STAGE_CLEAR, "clear"))==CL_SUCCESS);
         }
         
         // Binner interface methods
         void startNewFrame() {
+            TRACE_SCOPE("startNewFrame");
+            unmapColor(targets[currentTarget]);
             binner->startNewFrame();
+            
+            countingFrame = statsInterval > 0 && frameNumber % statsInterval == 0;
+            if (countingFrame) {
+                // The previous counted frame read the buffer before this fill in the (in-order) queue
+                assert(getGPU().getQueue().enqueueFillBuffer(statsBuffer, (uint32_t)0, 0, sizeof(uint32_t) * STAT_COUNT, nullptr, profiler.event(STAGE_CLEAR, "clear frame stats")) == CL_SUCCESS);
+            }
+            binner->setStatsBuffer(countingFrame ? &statsBuffer : nullptr);
+            vertexPool.reset();
+            texturePool.startFrame(TEXTURE_POOL_MAX_UNUSED_FRAMES);
+            vertexStream.beginFrame();
+            frameMeshDraws.clear();
+            if (instanceUpload()) {
+                instanceUpload.wait();
+                instanceUpload = cl::Event();
+            }
+            frameInstances.clear();
+            
+            // Meshes of this frame are drawn with the camera as it is now
+            float view[3][4];
+            camera.getViewMatrix(view);
+            for (int row = 0; row < 3; row++) {
+                cl_float4 viewRow = {{view[row][0], view[row][1], view[row][2], view[row][3]}};
+                assert(transformVerticesKernel->setArg(7 + row, viewRow) == CL_SUCCESS);
+            }
         }
         
-        void submitTriangleForBinning(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx, int color) {
-            binner->addTriangle(vertexBuffer, v0_idx, v1_idx, v2_idx, color);
+        void submitMesh(const Mesh& mesh) {
+            queueMeshDraw(mesh, -1, 1);
         }
         
-        void submitTexturedTriangleForBinning(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx,
+        void submitInstances(const Mesh& mesh, std::span<const Transform> transforms) {
+            if (transforms.empty()) return;
+            int firstInstance = (int)frameInstances.size();
+            frameInstances.insert(frameInstances.end(), transforms.begin(), transforms.end());
+            queueMeshDraw(mesh, firstInstance, (int)transforms.size());
+        }
+        
+        void queueMeshDraw(const Mesh& mesh, int firstInstance, int instanceCount) {
+            TRACE_SCOPE("submitMesh");
+            // Every instance gets its own camera-space copy of the mesh's vertices
+            int vertexBase = vertexPool.allocate(mesh.getVertexCount() * instanceCount);
+            frameMeshDraws.push_back({mesh.getVertexBuffer().getCLBuffer(), (int)mesh.getVertexCount(), firstInstance, instanceCount, vertexBase,
+                                      mesh.getVertexBuffer().getAllocation()});
+            
+            int texOffset = -1;
+            if (mesh.getTexture().has_value()) {
+                const Texture& texture = *mesh.getTexture();
+                texOffset = texturePool.acquire(texture.getCLBuffer(), texture.getPixelCount(), 0, texture.getAllocation());
+            }
+            binner->addMesh(mesh, instanceCount, vertexBase, texOffset);
+        }
+        
+        void transformMeshes() {
+            if (frameMeshDraws.empty()) return;
+            TRACE_SCOPE("transformMeshes");
+            
+            // startNewFrame waits for the upload before frameInstances is reused
+            uint64_t enqueued = lr::trace::now();
+            instanceBuffer.writeFrom(frameInstances, false, &instanceUpload);
+            profiler.record(STAGE_UPLOAD, "write instances", instanceUpload, enqueued);
+            assert(transformVerticesKernel->setArg(2, instanceBuffer.getCLBuffer()) == CL_SUCCESS);
+            assert(transformVerticesKernel->setArg(5, vertexPool.getCLBuffer()) == CL_SUCCESS);
+            
+            for (const MeshDraw& draw : frameMeshDraws) {
+                assert(transformVerticesKernel->setArg(0, draw.vertices) == CL_SUCCESS);
+                assert(transformVerticesKernel->setArg(1, draw.vertexCount) == CL_SUCCESS);
+                assert(transformVerticesKernel->setArg(3, draw.firstInstance) == CL_SUCCESS);
+                assert(transformVerticesKernel->setArg(4, draw.instanceCount) == CL_SUCCESS);
+                assert(transformVerticesKernel->setArg(6, draw.vertexBase) == CL_SUCCESS);
+                cl::NDRange workSize((size_t)draw.vertexCount * draw.instanceCount);
+                assert(getGPU().getQueue().enqueueNDRangeKernel(*transformVerticesKernel, cl::NullRange, workSize, cl::NullRange, nullptr, profiler.event(STAGE_TRANSFORM, "transformVertices")) == CL_SUCCESS);
+            }
+        }
+        
+        lr::BufferRange<vec> streamVertices(std::span<const vec> vertices) {
+            return vertexStream.allocate(vertices);
+        }
+        
+        // Streamed vertices only reach the device in executeBinningPass, so their copy waits for it.
+        // Any other buffer is copied right away - the caller may write new contents into it before then.
+        int acquireVertices(const lr::BufferRange<vec>& vertices) {
+            bool streamed = vertices.buffer() == vertexStream.getCLBuffer()();
+            return vertexPool.acquire(vertices.buffer, vertices.count, vertices.offset, vertices.owner, !streamed);
+        }
+        
+        void submitTriangleForBinning(const lr::BufferRange<vec>& vertices, int v0_idx, int v1_idx, int v2_idx, int color) {
+            int base = acquireVertices(vertices);
+            binner->addTriangle(base + v0_idx, base + v1_idx, base + v2_idx, color);
+        }
+        
+        void submitTexturedTriangleForBinning(const lr::BufferRange<vec>& vertices, int v0_idx, int v1_idx, int v2_idx,
                                             const TexCoord& ta, const TexCoord& tb, const TexCoord& tc, const Texture& texture) {
-            binner->addTexturedTriangle(vertexBuffer, v0_idx, v1_idx, v2_idx, ta, tb, tc, texture);
+            int base = acquireVertices(vertices);
+            int texOffset = texturePool.acquire(texture.getCLBuffer(), texture.getPixelCount(), 0, texture.getAllocation());
+            binner->addTexturedTriangle(base + v0_idx, base + v1_idx, base + v2_idx, ta, tb, tc,
+                                        texOffset, texture.getWidth(), texture.getHeight());
         }
         
         void executeBinningPass() {
-            binner->runBinningPass();
+            // The streamed vertices have to be on the device before the pool copies them
+            uint64_t enqueued = lr::trace::now();
+            cl::Event streamUpload = vertexStream.flush();
+            if (streamUpload()) profiler.record(STAGE_UPLOAD, "write streamed vertices", streamUpload, enqueued);
+            vertexPool.flushCopies();
+            texturePool.flushCopies();
+            transformMeshes();
+            binner->runBinningPass(vertexPool.getCLBuffer());
         }
         
         // Execute tile-based rendering using the binned triangle data
         void executeFinishFrameTileBased() {
+            TRACE_SCOPE("renderTiles");
             if (!binner || binner->getTriangleCount() == 0) {
                 LOG_DEBUG("No triangles to render with tile-based approach");
                 return;
@@ -496,38 +1501,56 @@ class _Renderer {
             LOG_DEBUG("Starting tile-based rendering for " + std::to_string(binner->getTilesPerRow()) + 
                       "x" + std::to_string(binner->getTilesPerColumn()) + " tiles");
             
-            auto renderTileKernel = binner->getRenderTileKernel();
+            // Frames without textures run the variant that has the texture path compiled out
+            auto renderTileKernel = getRenderTileKernel(binner->hasTexturedTriangles());
+            FrameTarget& target = targets[currentTarget];
+            assert(renderTileKernel->setArg(0, *target.depth) == CL_SUCCESS);
+            assert(renderTileKernel->setArg(1, *target.color) == CL_SUCCESS);
+            binner->bindTileLists(*renderTileKernel, 5);
+            assert(renderTileKernel->setArg(8, binner->getSetupBuffer().getCLBuffer()) == CL_SUCCESS);
+            assert(renderTileKernel->setArg(9, texturePool.getCLBuffer()) == CL_SUCCESS);
+            binner->bindStats(*renderTileKernel, 10);
+            assert(renderTileKernel->setArg(11, binner->getTriangleCount()) == CL_SUCCESS);
             
-            // Render each tile using the renderTile kernel
-            for (int tile_y = 0; tile_y < binner->getTilesPerColumn(); tile_y++) {
-                for (int tile_x = 0; tile_x < binner->getTilesPerRow(); tile_x++) {
-                    // Set kernel arguments for renderTile
-                    assert(renderTileKernel->setArg(0, *depth) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(1, *color) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(2, maxx) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(3, maxy) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(4, binner->getTileBuffer()->getCLBuffer()) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(5, binner->getTriangleBuffer()->getCLBuffer()) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(6, tile_x) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(7, tile_y) == CL_SUCCESS);
-                    assert(renderTileKernel->setArg(8, binner->getTilesPerRow()) == CL_SUCCESS);
-                    
-                    // Launch kernel for this tile (TILE_SIZE x TILE_SIZE work items)
-                    cl::NDRange tileWorkSize(TILE_SIZE, TILE_SIZE);
-                    assert(getGPU().getQueue().enqueueNDRangeKernel(*renderTileKernel, cl::NullRange, tileWorkSize, cl::NullRange) == CL_SUCCESS);
-                }
-            }
+            // One dispatch for the whole tile grid - every work-group renders one tile
+            cl::NDRange globalWorkSize(binner->getTilesPerRow() * tileLocalX, binner->getTilesPerColumn() * tileLocalY);
+            cl::NDRange localWorkSize(tileLocalX, tileLocalY);
+            assert(getGPU().getQueue().enqueueNDRangeKernel(*renderTileKernel, cl::NullRange, globalWorkSize, localWorkSize, nullptr, profiler.event(STAGE_RENDER, "renderTile")) == CL_SUCCESS);
             
-            // Wait for all tile rendering to complete
-            getGPU().getQueue().finish();
+            // Don't wait - finishFrame picks the frame up once it's done
+            getGPU().getQueue().flush();
             
-            LOG_DEBUG("Tile-based rendering completed");
+            LOG_DEBUG("Tile-based rendering submitted");
         }
         
         int getBinnedTriangleCount() const {
             return binner->getTriangleCount();
         }
         
+        void setBinningMode(BinningMode mode) {
+            binner->setMode(mode);
+        }
+        
+        BinningMode getBinningMode() const {
+            return binner->getMode();
+        }
+        
+        TileConfig getTileConfig() const {
+            return {binner->getTileSize(), (int)tileLocalX, (int)tileLocalY};
+        }
+        
+        FrameTimingReport getFrameTimings() const {
+            return profiler.report();
+        }
+        
+        void setFrameStatsInterval(int frames) {
+            statsInterval = std::max(frames, 0);
+        }
+        
+        std::optional<FrameStats> getFrameStats() const {
+            return lastStats;
+        }
+        
         // Camera management
         void setCamera(const Camera& camera) {
             this->camera = camera;
@@ -543,8 +1566,12 @@ class _Renderer {
 
 };
 
-Renderer::Renderer(int scr_w, int scr_h, int scr_y){
-    pimpl = new _Renderer(scr_w,scr_h,scr_y);
+Renderer::Renderer(int scr_w, int scr_h, int scr_y, int framesInFlight, TuningMode tuning){
+    pimpl = new _Renderer(scr_w,scr_h,scr_y,framesInFlight,resolveTileConfig(scr_w,scr_h,scr_y,tuning));
+}
+
+Renderer::Renderer(int scr_w, int scr_h, int scr_y, int framesInFlight, const TileConfig& tiles){
+    pimpl = new _Renderer(scr_w,scr_h,scr_y,framesInFlight,tiles);
 }
 
 Renderer::~Renderer(){
@@ -555,6 +1582,35 @@ uint32_t* Renderer::finishFrame() {
     return pimpl->finishFrame();
 }
 
+uint64_t Renderer::lastFrameNumber() const {
+    return pimpl->lastFrameNumber();
+}
+
+bool Renderer::finishFrame(uint32_t* destination, int pitch) {
+    MemoryRenderTarget target(destination, pitch);
+    return finishFrame(target);
+}
+
+bool Renderer::finishFrame(RenderTarget& target) {
+    uint32_t* pixels = pimpl->finishFrame();
+    if (!pixels) return false;
+    target.present(pixels, pimpl->getWidth(), pimpl->getHeight(), pimpl->lastFrameNumber());
+    return true;
+}
+
+uint32_t* Renderer::finishPendingFrame() {
+    return pimpl->finishPendingFrame();
+}
+
+int Renderer::finishPendingFrames(RenderTarget& target) {
+    int count = 0;
+    while (uint32_t* pixels = pimpl->finishPendingFrame()) {
+        target.present(pixels, pimpl->getWidth(), pimpl->getHeight(), pimpl->lastFrameNumber());
+        count++;
+    }
+    return count;
+}
+
 // Old triangle drawing wrapper methods removed - use binning system instead
 
 void Renderer::clear(){
@@ -566,13 +1622,34 @@ void Renderer::startNewFrame() {
     pimpl->startNewFrame();
 }
 
+lr::BufferRange<vec> Renderer::streamVertices(std::span<const vec> vertices) {
+    return pimpl->streamVertices(vertices);
+}
+
+void Renderer::submitTriangleForBinning(const lr::BufferRange<vec>& vertices, int v0_idx, int v1_idx, int v2_idx, int color) {
+    pimpl->submitTriangleForBinning(vertices, v0_idx, v1_idx, v2_idx, color);
+}
+
+void Renderer::submitTexturedTriangleForBinning(const lr::BufferRange<vec>& vertices, int v0_idx, int v1_idx, int v2_idx,
+                                               const TexCoord& ta, const TexCoord& tb, const TexCoord& tc, const Texture& texture) {
+    pimpl->submitTexturedTriangleForBinning(vertices, v0_idx, v1_idx, v2_idx, ta, tb, tc, texture);
+}
+
 void Renderer::submitTriangleForBinning(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx, int color) {
-    pimpl->submitTriangleForBinning(vertexBuffer, v0_idx, v1_idx, v2_idx, color);
+    pimpl->submitTriangleForBinning({vertexBuffer.getCLBuffer(), 0, vertexBuffer.size(), vertexBuffer.getAllocation()}, v0_idx, v1_idx, v2_idx, color);
 }
 
 void Renderer::submitTexturedTriangleForBinning(const lr::BaseBuffer<vec>& vertexBuffer, int v0_idx, int v1_idx, int v2_idx,
                                               const TexCoord& ta, const TexCoord& tb, const TexCoord& tc, const Texture& texture) {
-    pimpl->submitTexturedTriangleForBinning(vertexBuffer, v0_idx, v1_idx, v2_idx, ta, tb, tc, texture);
+    pimpl->submitTexturedTriangleForBinning({vertexBuffer.getCLBuffer(), 0, vertexBuffer.size(), vertexBuffer.getAllocation()}, v0_idx, v1_idx, v2_idx, ta, tb, tc, texture);
+}
+
+void Renderer::submitMesh(const Mesh& mesh) {
+    pimpl->submitMesh(mesh);
+}
+
+void Renderer::submitInstances(const Mesh& mesh, std::span<const Transform> transforms) {
+    pimpl->submitInstances(mesh, transforms);
 }
 
 void Renderer::executeBinningPass() {
@@ -587,6 +1664,38 @@ int Renderer::getBinnedTriangleCount() const {
     return pimpl->getBinnedTriangleCount();
 }
 
+void Renderer::setBinningMode(BinningMode mode) {
+    pimpl->setBinningMode(mode);
+}
+
+BinningMode Renderer::getBinningMode() const {
+    return pimpl->getBinningMode();
+}
+
+TileConfig Renderer::getTileConfig() const {
+    return pimpl->getTileConfig();
+}
+
+void Renderer::setReadbackMode(ReadbackMode mode) {
+    pimpl->setReadbackMode(mode);
+}
+
+ReadbackMode Renderer::getReadbackMode() const {
+    return pimpl->getReadbackMode();
+}
+
+FrameTimingReport Renderer::getFrameTimings() const {
+    return pimpl->getFrameTimings();
+}
+
+void Renderer::setFrameStatsInterval(int frames) {
+    pimpl->setFrameStatsInterval(frames);
+}
+
+std::optional<FrameStats> Renderer::getFrameStats() const {
+    return pimpl->getFrameStats();
+}
+
 void Renderer::setCamera(const Camera& camera) {
     pimpl->setCamera(camera);
 }
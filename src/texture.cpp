@@ -6,7 +6,7 @@
 #include "../include/stb_image.h"
 
 Texture::Texture(int w, int h, const std::vector<uint32_t>& data) 
-    : width(w), height(h), buffer(w * h, data) {
+    : width(w), height(h), buffer(w * h, gpuDevicePool(), data, lr::MEM_TEXTURE) {
     if (data.empty()) {
         LOG_FATAL("ConstBuffer requires initial data - cannot create empty texture");
     }
@@ -14,7 +14,7 @@ Texture::Texture(int w, int h, const std::vector<uint32_t>& data)
 }
 
 Texture::Texture(int w, int h, std::span<const uint32_t> data)
-    : width(w), height(h), buffer(w * h, data) {
+    : width(w), height(h), buffer(w * h, gpuDevicePool(), data, lr::MEM_TEXTURE) {
     LOG_DEBUG("Created texture from span " + std::to_string(w) + "x" + std::to_string(h));
 }
 
@@ -0,0 +1,132 @@
+#include "../include/trace.hpp"
+#include "../include/log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lr {
+    namespace trace {
+
+        namespace {
+            // Process ids in the trace - CPU threads and the device queue show up as separate groups
+            const int CPU_PID = 1;
+            const int DEVICE_PID = 2;
+
+            struct Event {
+                std::string name;
+                std::string category;
+                int pid, tid;
+                uint64_t begin, end;
+            };
+
+            std::string escape(const std::string& text) {
+                std::string result;
+                for (char c : text) {
+                    if (c == '"' || c == '\\') result += '\\';
+                    if ((unsigned char)c >= 0x20) result += c;
+                }
+                return result;
+            }
+
+            void writeEvent(std::ofstream& file, const Event& event, uint64_t origin) {
+                // Chrome trace timestamps are microseconds
+                file << "{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" << escape(event.category)
+                     << "\",\"ph\":\"X\",\"pid\":" << event.pid << ",\"tid\":" << event.tid
+                     << ",\"ts\":" << (event.begin - origin) / 1000.0
+                     << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+            }
+
+            struct Recorder {
+                std::mutex mutex;
+                std::atomic<bool> recording{false};
+                std::string path;
+                std::vector<Event> events;
+                std::unordered_map<std::thread::id, int> threadIds;
+                uint64_t origin = 0;
+
+                // Writes the recorded events to path and stops recording
+                void stop() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!recording) return;
+                    recording = false;
+
+                    std::ofstream file(path);
+                    if (!file.is_open()) {
+                        LOG_ERR("Can't write trace file " + path);
+                        return;
+                    }
+                    // Microseconds with nanosecond digits - the default 6 significant digits
+                    // would round timestamps to 10 us after a second of tracing
+                    file << std::fixed << std::setprecision(3);
+                    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+                    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << CPU_PID << ",\"args\":{\"name\":\"CPU\"}},\n";
+                    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << DEVICE_PID << ",\"args\":{\"name\":\"OpenCL device\"}}";
+                    for (const Event& event : events) {
+                        file << ",\n";
+                        // Device commands can be timestamped before the trace started
+                        Event clamped = event;
+                        clamped.begin = std::max(event.begin, origin);
+                        clamped.end = std::max(event.end, clamped.begin);
+                        writeEvent(file, clamped, origin);
+                    }
+                    file << "\n]}\n";
+                    LOG_INFO("Wrote " + std::to_string(events.size()) + " trace events to " + path);
+                    events.clear();
+                }
+
+                // Unwritten events are saved at exit
+                ~Recorder() { stop(); }
+            };
+
+            Recorder& recorder() {
+                static Recorder instance;
+                return instance;
+            }
+        }
+
+        uint64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void start(const std::string& path) {
+            Recorder& r = recorder();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.path = path;
+            r.events.clear();
+            r.origin = now();
+            r.recording = true;
+            LOG_INFO("Recording trace to " + path);
+        }
+
+        void stop() {
+            recorder().stop();
+        }
+
+        bool isRecording() {
+            return recorder().recording;
+        }
+
+        void addCpuEvent(const std::string& name, uint64_t begin, uint64_t end) {
+            Recorder& r = recorder();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            if (!r.recording) return;
+            auto [it, inserted] = r.threadIds.try_emplace(std::this_thread::get_id(), (int)r.threadIds.size() + 1);
+            r.events.push_back({name, "cpu", CPU_PID, it->second, begin, end});
+        }
+
+        void addDeviceEvent(const std::string& name, const std::string& category, uint64_t begin, uint64_t end) {
+            Recorder& r = recorder();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            if (!r.recording) return;
+            r.events.push_back({name, category, DEVICE_PID, 1, begin, end});
+        }
+
+    }
+}
@@ -91,6 +91,24 @@ vec VX(float x, float y, float z){
     return vec{x,y,z};
 }
 
+Transform::Transform(const vec& translation, const vec& scale, float yaw) {
+    float cosA = cos(yaw);
+    float sinA = sin(yaw);
+
+    // Same rotation as rotY
+    m[0][0] = cosA * scale.x;  m[0][1] = 0.0f;     m[0][2] = sinA * scale.z;  m[0][3] = translation.x;
+    m[1][0] = 0.0f;            m[1][1] = scale.y;  m[1][2] = 0.0f;            m[1][3] = translation.y;
+    m[2][0] = -sinA * scale.x; m[2][1] = 0.0f;     m[2][2] = cosA * scale.z;  m[2][3] = translation.z;
+}
+
+vec Transform::apply(const vec& v) const {
+    return vec{
+        m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3],
+        m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3],
+        m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3]
+    };
+}
+
 vec operator*(float scalar, const vec& v) {
     return v * scalar;
 }